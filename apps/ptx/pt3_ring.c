@@ -0,0 +1,213 @@
+/*
+	pt3_ring: PT3 DMA ring bookkeeping of pt3_thread() checked without hardware
+
+	A simulated FPGA writes ptx_sim style packets (sync, PID 0x100, running CC,
+	little-endian u64 sequence number at +4) front to back through a ring of
+	blocks. The consumer pass below is the drain loop of pt3_thread() in
+	drivers/media/pci/ptx/pt3_pci.c minus the sleeping, keep both in sync.
+
+	Checked per scenario:
+	- the consumer never writes into the block the FPGA is filling
+	- delivered sequence numbers never go back
+	- ring_full, overruns & lost_pkts match what the FPGA actually did
+
+	usage: pt3_ring		(exit status 0 if all scenarios pass)
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+enum {
+	TS_SIZE		= 188,
+	TS_SYNC		= 0x47,
+	TS_NOT_SYNC	= 0x74,
+	BLK_CNT		= 5,
+	BLK_PKTS	= 8,
+	BLK_SZ		= BLK_PKTS * TS_SIZE,
+};
+
+struct ring {
+	uint8_t		dat[BLK_CNT][BLK_SZ];	/* back to back, as the contiguous DMA ring */
+	uint32_t	ts_blk_idx,
+			ts_blk_hw;
+	uint64_t	ring_full,
+			overruns,
+			lost_pkts;
+	uint64_t	wr;			/* FPGA: packets written */
+	uint32_t	stall;			/* FPGA: packets written while the next demux call runs */
+	uint64_t	next,			/* demux: next expected sequence number */
+			gaps,
+			delivered;
+	int		bad;
+};
+
+uint32_t fpga_blk(struct ring *r)	/* the block the FPGA is filling */
+{
+	return r->wr / BLK_PKTS % BLK_CNT;
+}
+
+void fpga(struct ring *r, uint64_t pkts)
+{
+	for (; pkts; pkts--, r->wr++) {
+		uint8_t	*d	= r->dat[fpga_blk(r)] + r->wr % BLK_PKTS * TS_SIZE;
+		int	i;
+
+		d[0]	= TS_SYNC;
+		d[1]	= 0x01;
+		d[2]	= 0x00;
+		d[3]	= 0x10 | (r->wr & 0x0F);
+		for (i = 0; i < 8; i++)
+			d[4 + i] = r->wr >> (i * 8);
+		memset(d + 12, 0xFF, TS_SIZE - 12);
+	}
+}
+
+void demux(struct ring *r, const uint8_t *buf, uint32_t cnt)
+{
+	for (; cnt; cnt--, buf += TS_SIZE) {
+		uint64_t	seq	= 0;
+		int		i;
+
+		for (i = 7; i >= 0; i--)
+			seq = seq << 8 | buf[4 + i];
+		if (buf[0] != TS_SYNC || seq < r->next) {
+			printf("  delivered packet %llu after %llu\n", (unsigned long long)seq, (unsigned long long)r->next);
+			r->bad++;
+			continue;
+		}
+		r->gaps		+= seq - r->next;
+		r->next		= seq + 1;
+		r->delivered++;
+	}
+	fpga(r, r->stall);		/* the FPGA moves on while the demux runs */
+	r->stall = 0;
+}
+
+void mark_read(struct ring *r, uint32_t b)	/* pt3_mark_read() */
+{
+	if (b == fpga_blk(r)) {
+		printf("  consumer wrote into block %u, the FPGA's\n", b);
+		r->bad++;
+	}
+	r->dat[b][0]		= TS_NOT_SYNC;
+	r->dat[b][BLK_SZ - TS_SIZE]	= TS_NOT_SYNC;
+}
+
+void init(struct ring *r)	/* pt3_dma_run(adap, true), before the FPGA starts */
+{
+	uint32_t i;
+
+	memset(r, 0, sizeof(*r));
+	for (i = 0; i < BLK_CNT; i++)
+		r->dat[i][0] = r->dat[i][BLK_SZ - TS_SIZE] = TS_NOT_SYNC;
+	r->ts_blk_hw = BLK_CNT;
+}
+
+bool lapped(struct ring *r)
+{
+	uint32_t	prev	= (r->ts_blk_idx + BLK_CNT - 1) % BLK_CNT;
+
+	return prev != r->ts_blk_hw && r->dat[prev][BLK_SZ - TS_SIZE] == TS_SYNC;
+}
+
+void overrun(struct ring *r, uint32_t lost)
+{
+	r->overruns++;
+	r->lost_pkts	+= lost;
+	r->ts_blk_hw	= r->ts_blk_idx;
+	r->ts_blk_idx	= (r->ts_blk_idx + 1) % BLK_CNT;
+}
+
+void pass(struct ring *r)	/* 1 wakeup of pt3_thread() */
+{
+	uint32_t n;
+
+	for (n = 0; n < BLK_CNT - 1; n++)
+		if (r->dat[(r->ts_blk_idx + n + 1) % BLK_CNT][0] != TS_SYNC)
+			break;
+	if (!n)
+		return;
+	if (n == BLK_CNT - 1)
+		r->ring_full++;
+	if (lapped(r)) {
+		overrun(r, BLK_PKTS);
+		n--;
+	}
+	while (n) {
+		uint32_t	run	= 1,
+				b	= r->ts_blk_idx,
+				len	= BLK_SZ;
+
+		while (run < n && b + run < BLK_CNT)
+			len += BLK_SZ, run++;
+		demux(r, r->dat[b], len / TS_SIZE);
+		if (r->ts_blk_idx == r->ts_blk_hw)
+			r->ts_blk_hw = BLK_CNT;
+		if (lapped(r)) {
+			overrun(r, 0);
+			b++;
+			run--;
+			n--;
+		}
+		for (n -= run; run; run--, b++)
+			mark_read(r, b % BLK_CNT);
+		r->ts_blk_idx = b % BLK_CNT;
+	}
+}
+
+void steady(struct ring *r, int blocks)
+{
+	while (blocks--) {
+		fpga(r, BLK_PKTS);
+		pass(r);
+	}
+}
+
+int check(const char *name, struct ring *r, uint64_t ring_full, uint64_t overruns, uint64_t lost, uint64_t gaps)
+{
+	bool ok = !r->bad && r->ring_full == ring_full && r->overruns == overruns && r->lost_pkts == lost && r->gaps == gaps
+		&& r->delivered + r->gaps == r->next;
+
+	printf("%-26s ring_full %llu overruns %llu lost_pkts %llu gaps %llu delivered %llu/%llu: %s\n", name,
+		(unsigned long long)r->ring_full, (unsigned long long)r->overruns, (unsigned long long)r->lost_pkts,
+		(unsigned long long)r->gaps, (unsigned long long)r->delivered, (unsigned long long)r->wr, ok ? "ok" : "FAIL");
+	return !ok;
+}
+
+int main(void)
+{
+	struct ring	r;
+	int		fail	= 0;
+
+	init(&r);			/* consumer keeps up */
+	steady(&r, 100);
+	fail |= check("steady", &r, 0, 0, 0, 0);
+
+	init(&r);			/* FPGA refills the block read last: full, nothing lost */
+	fpga(&r, (BLK_CNT - 1) * BLK_PKTS + 1);
+	pass(&r);
+	steady(&r, 20);
+	fail |= check("ring full", &r, 1, 0, 0, 0);
+
+	init(&r);			/* FPGA is 3 packets into the oldest unread block */
+	fpga(&r, BLK_CNT * BLK_PKTS + 3);
+	pass(&r);
+	steady(&r, 20);
+	fail |= check("overrun", &r, 1, 1, BLK_PKTS, BLK_PKTS);
+
+	init(&r);			/* ring full, FPGA gets into the oldest block while it is demuxed */
+	fpga(&r, (BLK_CNT - 1) * BLK_PKTS + 1);
+	r.stall = BLK_PKTS;
+	pass(&r);
+	steady(&r, 20);
+	fail |= check("overrun during demux", &r, 1, 1, 0, 0);
+
+	init(&r);			/* several laps: lost_pkts is a lower bound */
+	fpga(&r, 3 * BLK_CNT * BLK_PKTS + 2);
+	pass(&r);
+	steady(&r, 20);
+	fail |= check("overrun, 3 laps", &r, 1, 1, BLK_PKTS, 2 * BLK_CNT * BLK_PKTS + BLK_PKTS);
+
+	return fail;
+}
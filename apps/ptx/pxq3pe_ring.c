@@ -0,0 +1,297 @@
+/*
+	pxq3pe_ring: stress test of the PX-Q3PE sBuf single-producer/single-consumer ring
+
+	The producer is the fan-out loop of pxq3pe_irq_thread(), the consumer the
+	index handling of pxq3pe_thread() and the restart the index reset of
+	pxq3pe_dma(), all in drivers/media/pci/ptx/pxq3pe_pci.c: keep them in sync.
+	smp_load_acquire() & smp_store_release() are the GCC __atomic builtins,
+	synchronize_irq() waits out a producer batch in progress.
+
+	The stream is stopped and restarted every few ms, as ptx_stop_feed() &
+	ptx_start_feed() do. Payloads are scrambled by the producer and
+	descrambled by the consumer as pxq3pe_thread() does. Each delivered packet
+	is checked for its sync byte, its payload, a rising sequence number and
+	the current stream generation.
+
+	Then the byte-wise descrambling loop pxq3pe_thread() used before is
+	timed against the current u64 one over a 1 MiB ring, after checking that
+	both give the same output. Both are built without SIMD, like the kernel.
+
+	usage: pxq3pe_ring [seconds]	(default 2, exit status 0 if no error)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define KERNEL_REGS		__attribute__((target("general-regs-only"), noinline))
+#else
+#define KERNEL_REGS		__attribute__((noinline))
+#endif
+#define load_acquire(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+enum {
+	TS_SIZE		= 188,
+	TS_SYNC		= 0x47,
+	SBUF_PKTS	= 61,		/* small & odd: wraps and fills often */
+	BATCH_MAX	= 40,		/* packets of 1 adapter in 1 DMA sub-buffer */
+	ROUND_MS	= 5,
+	BENCH_PKTS	= (1 << 20) / TS_SIZE,
+	BENCH_LOOPS	= 200,
+};
+
+int		idx[8]	= {0, 0, 3, 1, 0, 2, 1, 2},
+		xor[4]	= {0x2F, 0x46, 0x56, 0xE3};
+uint64_t	xor64;			/* xor[idx[0..7]] in memory order */
+
+struct {
+	uint8_t		sBuf[SBUF_PKTS * TS_SIZE];
+	uint32_t	sBufSize,
+			sBufStart,	/* consumer index, written by the consumer, or by restart while it is not running */
+			sBufStop;	/* producer index, written by the producer only */
+	uint32_t	feeds,
+			gen,		/* stream generation, stamped into the packets */
+			irq_seq,	/* odd while the producer is inside a batch */
+			quit,
+			stop_consumer;
+	uint64_t	seq,		/* producer: packets generated */
+			copied,
+			drops,
+			delivered,	/* consumer */
+			stale,		/* dropped by restart */
+			errors;
+} r = {.sBufSize = SBUF_PKTS * TS_SIZE};
+
+uint32_t rnd(uint32_t *s)
+{
+	*s = *s * 1103515245 + 12345;
+	return *s >> 16;
+}
+
+KERNEL_REGS void descramble_byte(uint8_t *rbuf, int sz)	/* pxq3pe_thread() before the u64 loop */
+{
+	int	i	= 0,
+		j	= 0,
+		k;
+
+	while (j < sz / TS_SIZE) {
+		j++;
+		i += 4;
+		while (i < j * TS_SIZE)
+			for (k = 0; k < 8; k++, i++)
+				rbuf[i] ^= xor[idx[k]];
+	}
+}
+
+KERNEL_REGS void descramble_u64(uint8_t *rbuf, int sz)	/* pxq3pe_thread() */
+{
+	int i, k;
+
+	for (i = 0; i < sz; i += TS_SIZE)
+		for (k = 4; k < TS_SIZE; k += 8) {
+			uint64_t w;
+
+			memcpy(&w, rbuf + i + k, 8);	/* get_unaligned() */
+			w ^= xor64;
+			memcpy(rbuf + i + k, &w, 8);	/* put_unaligned() */
+		}
+}
+
+void pkt_fill(uint8_t *d, uint64_t seq, uint32_t gen)
+{
+	int i;
+
+	d[0] = 0xC7;				/* adapter tag in the DMA buffer, the producer restores the sync byte */
+	memcpy(d + 4, &seq, 8);
+	memcpy(d + 12, &gen, 4);
+	for (i = 16; i < TS_SIZE; i++)
+		d[i] = seq * 31 + i;
+}
+
+bool pkt_ok(const uint8_t *d, uint64_t *seq, uint32_t *gen)
+{
+	int i;
+
+	memcpy(seq, d + 4, 8);
+	memcpy(gen, d + 12, 4);
+	if (d[0] != TS_SYNC)
+		return false;
+	for (i = 16; i < TS_SIZE; i++)
+		if (d[i] != (uint8_t)(*seq * 31 + i))
+			return false;
+	return true;
+}
+
+void *producer(void *arg)		/* pxq3pe_irq_thread() for 1 adapter */
+{
+	uint8_t		tbuf[BATCH_MAX * TS_SIZE];
+	uint32_t	s	= 1;
+
+	while (!load_acquire(&r.quit)) {
+		uint32_t	cnt	= rnd(&s) % BATCH_MAX + 1,
+				gen,
+				stop,
+				room,
+				j;
+
+		__atomic_add_fetch(&r.irq_seq, 1, __ATOMIC_SEQ_CST);
+		if (!load_acquire(&r.feeds))
+			goto out;
+		gen = load_acquire(&r.gen);
+		for (j = 0; j < cnt; j++)
+			pkt_fill(tbuf + j * TS_SIZE, r.seq++, gen);
+		descramble_byte(tbuf, cnt * TS_SIZE);		/* scramble, as received */
+		stop	= r.sBufStop;
+		room	= (load_acquire(&r.sBufStart) + r.sBufSize - stop - TS_SIZE) % r.sBufSize;
+		for (j = 0; j < cnt; j++) {
+			uint8_t *dst = &r.sBuf[stop];
+
+			if (room < TS_SIZE)
+				break;
+			memcpy(dst, tbuf + j * TS_SIZE, TS_SIZE);
+			*dst	= TS_SYNC;
+			stop	= (stop + TS_SIZE) % r.sBufSize;
+			room	-= TS_SIZE;
+		}
+		r.copied	+= j;
+		r.drops		+= cnt - j;
+		store_release(&r.sBufStop, stop);
+out:
+		__atomic_add_fetch(&r.irq_seq, 1, __ATOMIC_SEQ_CST);
+		sched_yield();
+	}
+	return NULL;
+}
+
+void *consumer(void *arg)		/* pxq3pe_thread() */
+{
+	uint32_t	gen	= load_acquire(&r.gen),
+			s	= gen;
+	uint64_t	last	= 0;
+	bool		first	= true;
+
+	while (!load_acquire(&r.stop_consumer)) {
+		uint32_t	start	= r.sBufStart,
+				stop	= load_acquire(&r.sBufStop),
+				sz	= (stop < start ? r.sBufSize : stop) - start,
+				i;
+
+		if (!sz) {
+			sched_yield();
+			continue;
+		}
+		descramble_u64(&r.sBuf[start], sz);
+		for (i = 0; i < sz; i += TS_SIZE) {
+			uint64_t	seq;
+			uint32_t	g;
+
+			if (!pkt_ok(&r.sBuf[start + i], &seq, &g) || g != gen || (!first && seq <= last)) {
+				fprintf(stderr, "bad packet: gen %u/%u seq %llu after %llu\n", g, gen,
+					(unsigned long long)seq, (unsigned long long)last);
+				r.errors++;
+			}
+			last	= seq;
+			first	= false;
+		}
+		r.delivered += sz / TS_SIZE;
+		if (!(rnd(&s) & 15))		/* a slow demux now and then, so the ring fills */
+			usleep(200);
+		store_release(&r.sBufStart, (start + sz) % r.sBufSize);
+	}
+	return NULL;
+}
+
+void synchronize_irq(void)
+{
+	uint32_t seq = __atomic_load_n(&r.irq_seq, __ATOMIC_SEQ_CST);
+
+	if (seq & 1)
+		while (__atomic_load_n(&r.irq_seq, __ATOMIC_SEQ_CST) == seq)
+			sched_yield();
+}
+
+double bench(void (*descramble)(uint8_t *, int), uint8_t *buf)	/* ns per packet */
+{
+	struct timespec	t0,
+			t1;
+	int		i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < BENCH_LOOPS; i++)
+		descramble(buf, BENCH_PKTS * TS_SIZE);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + t1.tv_nsec - t0.tv_nsec) / BENCH_LOOPS / BENCH_PKTS;
+}
+
+int xor_compare(void)
+{
+	static uint8_t	a[BENCH_PKTS * TS_SIZE],
+			b[BENCH_PKTS * TS_SIZE];
+	double		ns_byte,
+			ns_u64;
+	int		i;
+
+	for (i = 0; i < BENCH_PKTS; i++)
+		pkt_fill(a + i * TS_SIZE, i, 0);
+	memcpy(b, a, sizeof(a));
+	descramble_byte(a, sizeof(a));
+	descramble_u64(b, sizeof(b));
+	if (memcmp(a, b, sizeof(a))) {
+		fprintf(stderr, "byte & u64 descrambling differ\n");
+		return 1;
+	}
+	ns_byte	= bench(descramble_byte, a);
+	ns_u64	= bench(descramble_u64, b);
+	printf("descramble %d x %d packets: byte %.1f ns/packet (%.0f MB/s), u64 %.1f ns/packet (%.0f MB/s), %.1fx\n",
+		BENCH_LOOPS, BENCH_PKTS, ns_byte, TS_SIZE * 1e3 / ns_byte, ns_u64, TS_SIZE * 1e3 / ns_u64, ns_byte / ns_u64);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t	prod,
+			cons;
+	int		sec	= argc > 1 ? atoi(argv[1]) : 2,
+			rounds	= sec * 1000 / ROUND_MS,
+			i;
+
+	for (i = 0; i < 8; i++)
+		((uint8_t *)&xor64)[i] = xor[idx[i]];
+	pthread_create(&prod, NULL, producer, NULL);
+	for (i = 1; i <= rounds; i++) {
+		uint32_t	start	= r.sBufStart,
+				stop;
+
+		store_release(&r.gen, i);			/* ptx_start_feed() */
+		store_release(&r.feeds, 1);
+		synchronize_irq();				/* pxq3pe_dma(adap, true) */
+		stop = load_acquire(&r.sBufStop);
+		r.stale += (stop + r.sBufSize - start) % r.sBufSize / TS_SIZE;
+		store_release(&r.sBufStart, stop);
+		store_release(&r.stop_consumer, 0);
+		pthread_create(&cons, NULL, consumer, NULL);	/* woken after the DMA start */
+		usleep(ROUND_MS * 1000);
+		store_release(&r.feeds, 0);			/* ptx_stop_feed() */
+		store_release(&r.stop_consumer, 1);
+		pthread_join(cons, NULL);
+	}
+	store_release(&r.quit, 1);
+	pthread_join(prod, NULL);
+	r.stale += (r.sBufStop + r.sBufSize - r.sBufStart) % r.sBufSize / TS_SIZE;
+	if (r.copied != r.delivered + r.stale) {
+		fprintf(stderr, "%llu packets copied, %llu delivered + %llu stale\n", (unsigned long long)r.copied,
+			(unsigned long long)r.delivered, (unsigned long long)r.stale);
+		r.errors++;
+	}
+	printf("%d restarts, %llu packets: %llu delivered, %llu dropped full, %llu stale at restart, %llu errors\n",
+		rounds, (unsigned long long)r.seq, (unsigned long long)r.delivered, (unsigned long long)r.drops,
+		(unsigned long long)r.stale, (unsigned long long)r.errors);
+	return r.errors || xor_compare();
+}
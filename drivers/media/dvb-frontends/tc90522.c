@@ -13,9 +13,54 @@
 	GNU General Public License for more details.
  */
 
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <media/dvb_math.h>
 #include <media/dvb_frontend.h>
 #include "tc90522.h"
+#define CREATE_TRACE_POINTS
+#include "tc90522_trace.h"
+
+enum eTC90522 {
+	TC90522_POLL_MIN_US	= 200,	/* lock poll interval, grows with elapsed time	*/
+	TC90522_POLL_MAX_US	= 5000,
+	TC90522_POLL_SHIFT	= 4,	/* interval = elapsed / 16: detection lag <= ~6% */
+	TC90522_HIST_MAX	= 13,	/* <1ms, <2ms, <4ms ... <2048ms, longer		*/
+	TC90522_STAT_STALE	= 3,	/* sampling intervals before a sample is too old */
+};
+
+static int lock_timeout_ms = 2000;
+module_param(lock_timeout_ms, int, 0644);
+MODULE_PARM_DESC(lock_timeout_ms, "demod lock timeout after tuning in ms (10-10000, default 2000)");
+static int stat_ms = 1000;
+module_param(stat_ms, int, 0644);
+MODULE_PARM_DESC(stat_ms, "CN & lock sampling interval in ms while tuned, 0: I2C on every status query (default 1000)");
+
+struct tc90522_hist {		/* lock time histogram per delivery system */
+	atomic_t	bkt[TC90522_HIST_MAX],
+			timeout;
+	atomic64_t	us_sum;
+} tc90522_hist[2];		/* ISDB-S, ISDB-T */
+
+static struct dentry *tc90522_dbgfs;
+
+struct tc90522_stat {
+	ktime_t		ts;		/* 0: no sample since tuning */
+	s64		cnr;		/* .0001 dB */
+	enum fe_status	lock;
+	u32		unlocks;	/* samples that found a lock lost */
+};
+
+struct tc90522 {
+	enum fe_status		festat;
+	u32			tsid_freq;	/* ISDB-S carrier the slot table belongs to, 0: none */
+	u16			tsid[8];	/* slot -> TSID */
+	struct dvb_frontend	*fe;
+	struct delayed_work	stat_work;	/* background sampler, runs while tuned */
+	seqcount_t		stat_seq;
+	struct tc90522_stat	stat;
+	struct dentry		*dbgfs;
+};
 
 bool tc90522_r(struct i2c_client *c, u8 slvadr, u8 *buf, u8 len)
 {
@@ -60,16 +105,12 @@ int tc90522_cn_raw(struct dvb_frontend *fe, u16 *raw)	/* for DVBv3 compatibility
 	return cn;
 }
 
-int tc90522_status(struct dvb_frontend *fe, enum fe_status *stat)
+s64 tc90522_cn(u32 delsys, s64 raw)	/* @ .0001 dB */
 {
-	enum fe_status			*festat	= i2c_get_clientdata(fe->demodulator_priv);
-	struct dtv_frontend_properties	*c	= &fe->dtv_property_cache;
-	u16	v16;
-	s64	raw	= tc90522_cn_raw(fe, &v16),
-		x,
+	s64	x,
 		y;
 
-	s64 cn_s(void)	/* @ .0001 dB */
+	s64 cn_s(void)
 	{
 		raw -= 3000;
 		if (raw < 0)
@@ -83,7 +124,7 @@ int tc90522_status(struct dvb_frontend *fe, enum fe_status *stat)
 		return y < 0 ? 0 : y >> 16;
 	}
 
-	s64 cn_t(void)	/* @ .0001 dB */
+	s64 cn_t(void)
 	{
 		if (!raw)
 			return 0;
@@ -95,11 +136,97 @@ int tc90522_status(struct dvb_frontend *fe, enum fe_status *stat)
 		return y >> 22;
 	}
 
+	return delsys == SYS_ISDBS ? cn_s() : cn_t();
+}
+
+enum fe_status tc90522_lock(struct i2c_client *c, u32 delsys)
+{
+	u8	data[2];
+	bool	lock	= delsys == SYS_ISDBS ?
+			tc90522_r(c, 0xC3, data, 1) && !(data[0] & 0x10) :
+			tc90522_r(c, 0x80, data, 1) && tc90522_r(c, 0xB0, data + 1, 1) &&
+				!(data[0] & 0b00001000) && (data[1] & 0b00001000);
+
+	return lock ? FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_LOCK : 0;
+}
+
+void tc90522_stat_publish(struct tc90522 *d, const struct tc90522_stat *st)
+{
+	preempt_disable();
+	write_seqcount_begin(&d->stat_seq);
+	d->stat = *st;
+	write_seqcount_end(&d->stat_seq);
+	preempt_enable();
+}
+
+void tc90522_stat_get(struct tc90522 *d, struct tc90522_stat *st)	/* lock-free */
+{
+	u32	seq;
+
+	do {
+		seq = read_seqcount_begin(&d->stat_seq);
+		*st = d->stat;
+	} while (read_seqcount_retry(&d->stat_seq, seq));
+}
+
+void tc90522_stat_work(struct work_struct *work)
+{
+	struct tc90522		*d	= container_of(to_delayed_work(work), struct tc90522, stat_work);
+	struct dvb_frontend	*fe	= d->fe;
+	u32			delsys	= fe->dtv_property_cache.delivery_system;
+	struct tc90522_stat	st	= d->stat;	/* sole writer while running */
+	u16			v16;
+	int			raw	= tc90522_cn_raw(fe, &v16),
+				ms	= READ_ONCE(stat_ms);
+	enum fe_status		lock	= tc90522_lock(fe->demodulator_priv, delsys);
+
+	st.unlocks	+= st.ts && st.lock && !lock;
+	st.lock		= lock;
+	st.cnr		= raw < 0 ? 0 : tc90522_cn(delsys, raw);
+	st.ts		= ktime_get();
+	tc90522_stat_publish(d, &st);
+	if (ms > 0)
+		schedule_delayed_work(&d->stat_work, msecs_to_jiffies(ms));
+}
+
+void tc90522_stat_stop(struct tc90522 *d)
+{
+	struct tc90522_stat	st	= {};
+
+	cancel_delayed_work_sync(&d->stat_work);
+	st.unlocks = d->stat.unlocks;
+	tc90522_stat_publish(d, &st);
+}
+
+int tc90522_status(struct dvb_frontend *fe, enum fe_status *stat)
+{
+	struct tc90522			*d	= i2c_get_clientdata(fe->demodulator_priv);
+	struct dtv_frontend_properties	*c	= &fe->dtv_property_cache;
+	struct tc90522_stat		st;
+	int				ms	= READ_ONCE(stat_ms);
+	u16				v16;
+	s64				raw;
+
+	tc90522_stat_get(d, &st);
+	if (ms > 0 && st.ts && ktime_ms_delta(ktime_get(), st.ts) < ms * TC90522_STAT_STALE) {
+		c->cnr.len		= 1;
+		c->cnr.stat[0].svalue	= st.cnr;
+		c->cnr.stat[0].scale	= FE_SCALE_DECIBEL;
+		*stat = st.lock;
+		return *stat;
+	}
+	raw = tc90522_cn_raw(fe, &v16);
 	c->cnr.len		= 1;
-	c->cnr.stat[0].svalue	= fe->dtv_property_cache.delivery_system == SYS_ISDBS ? cn_s() : cn_t();
+	c->cnr.stat[0].svalue	= tc90522_cn(c->delivery_system, raw);
 	c->cnr.stat[0].scale	= FE_SCALE_DECIBEL;
-	*stat = *festat;
-	return *festat;
+	*stat = d->festat;
+	return d->festat;
+}
+
+int tc90522_sleep(struct dvb_frontend *fe)
+{
+	tc90522_stat_stop(i2c_get_clientdata(fe->demodulator_priv));
+	return 0;
 }
 
 enum dvbfe_algo tc90522_get_frontend_algo(struct dvb_frontend *fe)
@@ -150,19 +277,78 @@ int tc90522_tune(struct dvb_frontend *fe, bool retune, u32 mode_flags, u32 *dela
 	}
 
 	struct i2c_client	*c	= fe->demodulator_priv;
-	enum fe_status		*festat	= i2c_get_clientdata(c);
-	u16			set_id	= fe->dtv_property_cache.stream_id,
-				cnt	= 999;
+	struct tc90522		*d	= i2c_get_clientdata(c);
+	enum fe_status		*festat	= &d->festat;
+	u16			set_id	= fe->dtv_property_cache.stream_id;
 	u8			data[16];
+	u32			delsys	= fe->dtv_property_cache.delivery_system;
+	ktime_t			t0	= ktime_get(),
+				tp;	/* tuner programmed, lock polling starts */
+
+	bool poll_wait(void)	/* tight right after tuning, backing off as the lock takes longer */
+	{
+		ktime_t	t	= ktime_get();
+		u32	us	= ktime_us_delta(t, tp) >> TC90522_POLL_SHIFT;
+
+		if (ktime_ms_delta(t, tp) >= clamp(READ_ONCE(lock_timeout_ms), 10, 10000))
+			return false;
+		us = clamp_t(u32, us, TC90522_POLL_MIN_US, TC90522_POLL_MAX_US);
+		usleep_range(us, us + (us >> 2));
+		return true;
+	}
+
+	bool tsid_set(void)	/* select the slot matching stream_id (TSID or slot index) */
+	{
+		u8	i;
+
+		for (i = 0; i < 8; i++) {
+			u16 tsid = d->tsid[i];
+
+			if (!tsid || tsid == 0xffff)
+				continue;
+//pr_err("%s Freq %d TSID 0x%04x", __func__, fe->dtv_property_cache.frequency, tsid);
+			if ((set_id == tsid || set_id == i)	&&
+				tc90522_w(c, 0x8F, tsid >> 8)	&&
+				tc90522_w(c, 0x90, tsid & 0xFF)	&&
+				tc90522_r(c, 0xE6, data, 2)	&&
+				tc90522_n2int(data, 2) == tsid)
+				return true;
+		}
+		return false;
+	}
+
+	int done(bool lock)
+	{
+		struct tc90522_hist	*h	= tc90522_hist + (delsys != SYS_ISDBS);
+		u64			us	= ktime_us_delta(ktime_get(), t0);
+		u32			ms	= div_u64(us, 1000);
+
+		if (lock) {
+			trace_tc90522_tune_lock(c->addr, delsys, fe->dtv_property_cache.frequency, set_id, us);
+			atomic_inc(h->bkt + (ms ? min_t(int, fls(ms), TC90522_HIST_MAX - 1) : 0));
+			atomic64_add(us, &h->us_sum);
+			*festat = FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_LOCK;
+		} else {
+			trace_tc90522_tune_timeout(c->addr, delsys, fe->dtv_property_cache.frequency, set_id, us);
+			atomic_inc(&h->timeout);
+		}
+		*stat = *festat;
+		if (READ_ONCE(stat_ms) > 0)
+			schedule_delayed_work(&d->stat_work, 0);
+		return lock ? 0 : -ETIMEDOUT;
+	}
 
 	if (!retune)
 		return 0;
+	tc90522_stat_stop(d);		/* keep the sampler off the bus while tuning */
 	*festat = 0;
 	if (fe->dtv_property_cache.delivery_system == SYS_ISDBT) {
 		t_Hz(&fe->dtv_property_cache.frequency);
+		trace_tc90522_tune_start(c->addr, delsys, fe->dtv_property_cache.frequency, set_id, 0);
 		if (fe->ops.tuner_ops.set_params(fe))
 			return -EIO;
-		while (cnt--) {
+		tp = ktime_get();
+		do {
 			bool	retryov,
 				lock0,
 				lock1;
@@ -171,47 +357,38 @@ int tc90522_tune(struct dvb_frontend *fe, bool retune, u32 mode_flags, u32 *dela
 			retryov	= data[0] & 0b10000000 ? true : false;
 			lock0	= data[0] & 0b00001000 ? false : true;
 			lock1	= data[1] & 0b00001000 ? true : false;
-			if (lock0 && lock1) {
-				*festat = FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_LOCK;
-				*stat = *festat;
-				return 0;
-			}
+			if (lock0 && lock1)
+				return done(true);
 			if (retryov)
 				break;
-			msleep_interruptible(1);
-		}
+		} while (poll_wait());
 	} else {	// SYS_ISDBS
 		s_kHz(&fe->dtv_property_cache.frequency);
+		trace_tc90522_tune_start(c->addr, delsys, fe->dtv_property_cache.frequency, set_id, 0);
+		if (d->tsid_freq == fe->dtv_property_cache.frequency	&&	/* slot switch on the same carrier */
+			tc90522_r(c, 0xC3, data, 1) && !(data[0] & 0x10)	&&	/* still locked	*/
+			tsid_set())
+			return done(true);
+		d->tsid_freq = 0;
 		if (fe->ops.tuner_ops.set_params(fe))
 			return -EIO;
-		while (cnt--) {
+		tp = ktime_get();
+		do {
 			u8	i;
 
 			if	((tc90522_r(c, 0xC3, data, 1), !(data[0] & 0x10))	&&	/* locked	*/
 				(tc90522_r(c, 0xCE, data, 2), *(u16 *)data != 0)	&&	/* valid TSID	*/
 				tc90522_r(c, 0xC3, data, 1)				&&
-				tc90522_r(c, 0xCE, data, 16))
-				for (i = 0; i < 8; i++) {
-					u16 tsid = tc90522_n2int(data + i*2, 2);
-
-					if (!tsid || tsid == 0xffff)
-						continue;
-//pr_err("%s Freq %d TSID 0x%04x", __func__, fe->dtv_property_cache.frequency, tsid);
-					if ((set_id == tsid || set_id == i)	&&
-						tc90522_w(c, 0x8F, tsid >> 8)	&&
-						tc90522_w(c, 0x90, tsid & 0xFF)	&&
-						tc90522_r(c, 0xE6, data, 2)	&&
-						tc90522_n2int(data, 2) == tsid) {
-						*festat = FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_LOCK;
-						*stat = *festat;
-						return 0;
-					}
-				}
-			msleep_interruptible(1);
-		}
+				tc90522_r(c, 0xCE, data, 16)) {
+				for (i = 0; i < 8; i++)
+					d->tsid[i] = tc90522_n2int(data + i*2, 2);
+				d->tsid_freq = fe->dtv_property_cache.frequency;
+				if (tsid_set())
+					return done(true);
+			}
+		} while (poll_wait());
 	}
-	*stat = *festat;
-	return -ETIMEDOUT;
+	return done(false);
 }
 
 static struct dvb_frontend_ops tc90522_ops = {
@@ -226,16 +403,46 @@ static struct dvb_frontend_ops tc90522_ops = {
 	.read_snr	= tc90522_cn_raw,
 	.read_status	= tc90522_status,
 	.tune		= tc90522_tune,
+	.sleep		= tc90522_sleep,
 };
 
+int tc90522_stat_show(struct seq_file *m, void *v)
+{
+	struct tc90522_stat	st;
+
+	tc90522_stat_get(m->private, &st);
+	seq_printf(m, "lock\t%d\ncnr\t%lld\nunlocks\t%u\nage_ms\t%lld\n", !!(st.lock & FE_HAS_LOCK), st.cnr, st.unlocks,
+		st.ts ? ktime_ms_delta(ktime_get(), st.ts) : -1);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tc90522_stat);
+
+int tc90522_remove(struct i2c_client *c)
+{
+	struct tc90522	*d	= i2c_get_clientdata(c);
+
+	debugfs_remove(d->dbgfs);
+	cancel_delayed_work_sync(&d->stat_work);
+	kfree(d);
+	return 0;
+}
+
 int tc90522_probe(struct i2c_client *c, const struct i2c_device_id *id)
 {
 	struct dvb_frontend	*fe	= c->dev.platform_data;
-	static enum fe_status	festat	= 0;
+	struct tc90522		*d	= kzalloc(sizeof(struct tc90522), GFP_KERNEL);
+	char			name[32];
 
+	if (!d)
+		return -ENOMEM;
+	d->fe = fe;
+	INIT_DELAYED_WORK(&d->stat_work, tc90522_stat_work);
+	seqcount_init(&d->stat_seq);
 	memcpy(&fe->ops, &tc90522_ops, sizeof(struct dvb_frontend_ops));
 	fe->demodulator_priv = c;
-	i2c_set_clientdata(c, &festat);
+	i2c_set_clientdata(c, d);
+	snprintf(name, sizeof(name), "stat-%s", dev_name(&c->dev));
+	d->dbgfs = debugfs_create_file(name, 0444, tc90522_dbgfs, d, &tc90522_stat_fops);
 	return 0;
 }
 
@@ -248,9 +455,47 @@ MODULE_DEVICE_TABLE(i2c, tc90522_id);
 static struct i2c_driver tc90522_driver = {
 	.driver.name	= tc90522_id->name,
 	.probe		= tc90522_probe,
+	.remove		= tc90522_remove,
 	.id_table	= tc90522_id,
 };
-module_i2c_driver(tc90522_driver);
+
+int tc90522_hist_show(struct seq_file *m, void *v)
+{
+	struct tc90522_hist	*h	= m->private;
+	u32			n	= 0,
+				i;
+
+	for (i = 0; i < TC90522_HIST_MAX; i++) {
+		u32	k	= atomic_read(h->bkt + i);
+
+		n += k;
+		if (i < TC90522_HIST_MAX - 1)
+			seq_printf(m, "<%ums\t%u\n", 1 << i, k);
+		else
+			seq_printf(m, ">=%ums\t%u\n", 1 << (i - 1), k);
+	}
+	seq_printf(m, "timeout\t%u\nmean_us\t%llu\n", atomic_read(&h->timeout),
+		n ? div_u64(atomic64_read(&h->us_sum), n) : 0);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(tc90522_hist);
+
+static int __init tc90522_init(void)
+{
+	tc90522_dbgfs = debugfs_create_dir(TC90522_MODNAME, NULL);
+	debugfs_create_file("lock_isdbs", 0444, tc90522_dbgfs, tc90522_hist,     &tc90522_hist_fops);
+	debugfs_create_file("lock_isdbt", 0444, tc90522_dbgfs, tc90522_hist + 1, &tc90522_hist_fops);
+	return i2c_add_driver(&tc90522_driver);
+}
+
+static void __exit tc90522_exit(void)
+{
+	i2c_del_driver(&tc90522_driver);
+	debugfs_remove_recursive(tc90522_dbgfs);
+}
+
+module_init(tc90522_init);
+module_exit(tc90522_exit);
 
 MODULE_AUTHOR("Budi Rachmanto, AreMa Inc. <knightrider(@)are.ma>");
 MODULE_DESCRIPTION("Toshiba TC90522 8PSK(ISDB-S)/OFDM(ISDB-T) quad demodulator");
@@ -12,7 +12,69 @@
 #ifndef	TC90522_H
 #define	TC90522_H
 
+#include <linux/i2c.h>
+
 #define TC90522_MODNAME "tc90522"
 
-#endif
+/*
+ * Register write batches for tuners behind the demodulator's 0xFE gate.
+ * A batch goes out as one i2c_transfer of I2C_M_STOP-terminated writes:
+ * adapters with I2C_FUNC_PROTOCOL_MANGLING (PT3) run it as a single bus program,
+ * others get the messages one by one, as before.
+ */
+enum {
+	TC90522_BATCH_MAX	= 16,	/* messages, a full batch is sent at once	*/
+	TC90522_BATCH_LEN	= 20,	/* bytes per message, incl. gate & address	*/
+};
+
+struct tc90522_batch {
+	struct i2c_client	*demod;
+	struct i2c_msg		msg[TC90522_BATCH_MAX];
+	u8			buf[TC90522_BATCH_MAX][TC90522_BATCH_LEN],
+				n;
+	int			err;
+};
+
+static inline int tc90522_batch_run(struct tc90522_batch *b)
+{
+	struct i2c_adapter	*i2c	= b->demod->adapter;
+	int			i;
+
+	if (b->n && !b->err && i2c_check_functionality(i2c, I2C_FUNC_PROTOCOL_MANGLING))
+		b->err = i2c_transfer(i2c, b->msg, b->n) == b->n ? 0 : -EIO;
+	else
+		for (i = 0; i < b->n && !b->err; i++)
+			b->err = i2c_transfer(i2c, b->msg + i, 1) == 1 ? 0 : -EIO;
+	b->n = 0;
+	return b->err;
+}
 
+static inline void tc90522_batch_add(struct tc90522_batch *b, const u8 *hdr, u8 hlen, const u8 *dat, u8 len)
+{
+	u8 *buf;
+
+	if (hlen + len > TC90522_BATCH_LEN) {
+		b->err = -EINVAL;
+		return;
+	}
+	if (b->n == TC90522_BATCH_MAX)
+		tc90522_batch_run(b);
+	buf = b->buf[b->n];
+	memcpy(buf, hdr, hlen);
+	memcpy(buf + hlen, dat, len);
+	b->msg[b->n++] = (struct i2c_msg){.addr = b->demod->addr, .flags = I2C_M_STOP, .buf = buf, .len = hlen + len};
+}
+
+static inline void tc90522_batch_w(struct tc90522_batch *b, u8 adr, const u8 *dat, u8 len)	/* demod registers */
+{
+	tc90522_batch_add(b, &adr, 1, dat, len);
+}
+
+static inline void tc90522_batch_w_tuner(struct tc90522_batch *b, struct i2c_client *t, const u8 *dat, u8 len)
+{
+	u8 hdr[] = {0xFE, t->addr << 1};
+
+	tc90522_batch_add(b, hdr, sizeof(hdr), dat, len);
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+	Tracepoints for Toshiba TC90522 tuning
+
+	Copyright (C) Budi Rachmanto, AreMa Inc. <info@are.ma>
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tc90522
+
+#if !defined(TC90522_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define TC90522_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(tc90522_tune,	/* us: since tune start */
+	TP_PROTO(u16 addr, u32 delsys, u32 freq, u16 stream_id, u64 us),
+	TP_ARGS(addr, delsys, freq, stream_id, us),
+	TP_STRUCT__entry(
+		__field(u16,	addr)
+		__field(u32,	delsys)
+		__field(u32,	freq)
+		__field(u16,	stream_id)
+		__field(u64,	us)
+	),
+	TP_fast_assign(
+		__entry->addr		= addr;
+		__entry->delsys		= delsys;
+		__entry->freq		= freq;
+		__entry->stream_id	= stream_id;
+		__entry->us		= us;
+	),
+	TP_printk("0x%02x %s freq=%u id=0x%04x %lluus", __entry->addr, __entry->delsys == SYS_ISDBS ? "ISDBS" : "ISDBT",
+		__entry->freq, __entry->stream_id, __entry->us)
+);
+
+DEFINE_EVENT(tc90522_tune, tc90522_tune_start,
+	TP_PROTO(u16 addr, u32 delsys, u32 freq, u16 stream_id, u64 us),
+	TP_ARGS(addr, delsys, freq, stream_id, us)
+);
+
+DEFINE_EVENT(tc90522_tune, tc90522_tune_lock,
+	TP_PROTO(u16 addr, u32 delsys, u32 freq, u16 stream_id, u64 us),
+	TP_ARGS(addr, delsys, freq, stream_id, us)
+);
+
+DEFINE_EVENT(tc90522_tune, tc90522_tune_timeout,
+	TP_PROTO(u16 addr, u32 delsys, u32 freq, u16 stream_id, u64 us),
+	TP_ARGS(addr, delsys, freq, stream_id, us)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE tc90522_trace
+#include <trace/define_trace.h>
@@ -13,10 +13,14 @@
 #include "tc90522.h"
 #include "qm1d1c004x.h"
 #include "mxl301rf.h"
+#define PTX_TRACE_SYSTEM pt3
+#define CREATE_TRACE_POINTS
+#include "ptx_trace.h"
 
 MODULE_AUTHOR(PTX_AUTH);
 MODULE_DESCRIPTION("Earthsoft PT3 DVB Driver");
 MODULE_LICENSE("GPL");
+MODULE_SOFTDEP("pre: " TC90522_MODNAME " " QM1D1C004X_MODNAME " " MXL301RF_MODNAME);	/* async probe cannot request_module() */
 
 static struct pci_device_id pt3_id[] = {
 	{PCI_DEVICE(0x1172, 0x4c15)},
@@ -24,6 +28,18 @@ static struct pci_device_id pt3_id[] = {
 };
 MODULE_DEVICE_TABLE(pci, pt3_id);
 
+static int delivery = 1;
+module_param(delivery, int, 0644);
+MODULE_PARM_DESC(delivery, "TS delivery mode (0:busy poll 1:sleep at block-fill cadence, default)");
+static int	nb,
+		np,
+		ts_blk_cnt[4]	= {17, 17, 17, 17},
+		ts_blk_pg[4]	= {47, 47, 47, 47};
+module_param_array(ts_blk_cnt, int, &nb, 0444);
+MODULE_PARM_DESC(ts_blk_cnt, "DMA ring depth in blocks, per adapter (3-255, default 17)");
+module_param_array(ts_blk_pg, int, &np, 0444);
+MODULE_PARM_DESC(ts_blk_pg, "4080B pages per DMA block, per adapter (multiple of 47 up to 470, default 47)");
+
 enum ePT3 {
 	PT3_REG_VERSION	= 0x00,	/*	R	Version		*/
 	PT3_REG_BUS	= 0x04,	/*	R	Bus		*/
@@ -42,11 +58,16 @@ enum ePT3 {
 	PT3_TS_ERR	= 0x14,	/*	R	TS		*/
 
 	PT3_I2C_DATA_OFFSET	= 0x800,
+	PT3_I2C_PROG_MAX	= 0x400,	/* batched program size before it is flushed	*/
 	PT3_I2C_START_ADDR	= 0x17fa,
 
 	PT3_PWR_OFF		= 0x00,
 	PT3_PWR_AMP_ON		= 0x04,
 	PT3_PWR_TUNER_ON	= 0x40,
+
+	PT3_BLK_NS_MIN		= 1000000,	/* 1 ms, clamp of the block-fill period estimate	*/
+	PT3_BLK_NS_MAX		= 100000000,	/* 100 ms, ISDB-T low bitrate			*/
+	PT3_BLK_NS_INIT		= 20000000,	/* 20 ms, a bit below ISDB-S full rate		*/
 };
 
 struct pt3_card {
@@ -63,10 +84,17 @@ struct pt3_dma {
 struct pt3_adap {
 	u32	ts_blk_idx,
 		ts_blk_cnt,
+		ts_blk_hw,	/* unread block left to the FPGA after an overrun, ts_blk_cnt if none	*/
 		desc_pg_cnt;
 	void __iomem	*dma_base;
-	struct pt3_dma	*ts_info,
+	struct pt3_dma	ring,		/* 1 region backing ts_info & desc_info, if it could be had */
+			*ts_info,
 			*desc_info;
+	ktime_t	blk_last;
+	u64	blk_ns,		/* estimated block-fill period	*/
+		ring_full,	/* FPGA refilling the block read last, no loss yet	*/
+		overruns,	/* FPGA moved on into an unread block	*/
+		lost_pkts;	/* lower bound, the blocks skipped on overrun	*/
 };
 
 int pt3_i2c_flush(struct pt3_card *c, u32 start_addr)
@@ -74,14 +102,14 @@ int pt3_i2c_flush(struct pt3_card *c, u32 start_addr)
 	u32	val	= 0b0110,
 		i	= 999;
 
-	void i2c_wait(void)
+	void i2c_wait(void)	/* hrtimer sleeps: a jiffy per check held the bus 1-4 ms per transfer */
 	{
 		while (1) {
 			val = readl(c->bar_reg + PT3_REG_I2C_R);
 
 			if (!(val & 1))						/* sequence stopped */
 				return;
-			msleep_interruptible(0);
+			usleep_range(100, 200);
 		}
 	}
 
@@ -150,13 +178,48 @@ int pt3_i2c_xfr(struct i2c_adapter *i2c, struct i2c_msg *msg, int sz)
 				i2c_shoot(I_DATA_L_NOP);
 		}
 	}
-	int i, j;
 
-	if (sz < 1 || sz > 3 || !msg || msg[0].flags)		/* always write first */
+	int run(int first, int last)	/* execute the program, collect data read by msg[first..last] */
+	{
+		int	err,
+			j,
+			k	= 0;
+
+		i2c_shoot(I_END);
+		if (filled)
+			i2c_shoot(I_END);
+		err = pt3_i2c_flush(c, 0);
+		for (; !err && first <= last; first++)
+			if (msg[first].flags & I2C_M_RD)
+				for (j = 0; j < msg[first].len; j++)
+					msg[first].buf[j] = readb(c->bar_mem + PT3_I2C_DATA_OFFSET + k++);
+		offset	= 0;
+		filled	= false;
+		return err;
+	}
+
+	bool reads(int i)		/* the transaction starting at msg[i] reads */
+	{
+		for (; i < sz; i++)
+			if (msg[i].flags & (I2C_M_RD | I2C_M_STOP))
+				return msg[i].flags & I2C_M_RD;
+		return false;
+	}
+	int	i,
+		first	= 0;		/* 1st message of the pending program */
+	bool	txn	= true;		/* at a transaction boundary */
+
+	if (sz < 1 || !msg || msg[0].flags & I2C_M_RD)		/* always write first */
 		return -ENOTSUPP;
 	mutex_lock(&card->lock);
 	for (i = 0; i < sz; i++) {
-		u8 byte = (msg[i].addr << 1) | (msg[i].flags & 1);
+		u8	byte	= (msg[i].addr << 1) | (msg[i].flags & I2C_M_RD);
+
+		if (txn && i > first && reads(i)) {		/* read data lands at the program start: run pending writes first */
+			if (run(first, i - 1))
+				break;
+			first = i;
+		}
 
 		/* start */
 		i2c_shoot(I_DATA_H);
@@ -164,32 +227,35 @@ int pt3_i2c_xfr(struct i2c_adapter *i2c, struct i2c_msg *msg, int sz)
 		i2c_shoot(I_DATA_L);
 		i2c_shoot(I_CLOCK_L);
 		i2c_w(&byte, 1);
-		if (msg[i].flags == I2C_M_RD)
+		if (msg[i].flags & I2C_M_RD)
 			i2c_r(msg[i].len);
 		else
 			i2c_w(msg[i].buf, msg[i].len);
-	}
+		txn = i == sz - 1 || msg[i].flags & (I2C_M_RD | I2C_M_STOP);
+		if (!txn)					/* repeated start */
+			continue;
 
-	/* stop */
-	i2c_shoot(I_DATA_L);
-	i2c_shoot(I_CLOCK_H);
-	i2c_shoot(I_DATA_H);
-	i2c_shoot(I_END);
-	if (filled)
-		i2c_shoot(I_END);
-	if (pt3_i2c_flush(c, 0))
-		sz = -EIO;
-	else
-		for (i = 1; i < sz; i++)
-			if (msg[i].flags == I2C_M_RD)
-				for (j = 0; j < msg[i].len; j++)
-					msg[i].buf[j] = readb(c->bar_mem + PT3_I2C_DATA_OFFSET + j);
+		/* stop */
+		i2c_shoot(I_DATA_L);
+		i2c_shoot(I_CLOCK_H);
+		i2c_shoot(I_DATA_H);
+		if (i == sz - 1 || msg[i].flags & I2C_M_RD || offset >= PT3_I2C_PROG_MAX) {
+			if (run(first, i))
+				break;
+			first = i + 1;
+		}
+	}
 	mutex_unlock(&card->lock);
-	return sz;
+	return i < sz ? -EIO : sz;
+}
+
+u32 pt3_i2c_func(struct i2c_adapter *i2c)
+{
+	return ptx_i2c_func(i2c) | I2C_FUNC_PROTOCOL_MANGLING;	/* I2C_M_STOP: many transactions, 1 program */
 }
 
 static const struct i2c_algorithm pt3_i2c_algo = {
-	.functionality	= ptx_i2c_func,
+	.functionality	= pt3_i2c_func,
 	.master_xfer	= pt3_i2c_xfr,
 };
 
@@ -211,6 +277,12 @@ int pt3_power(struct dvb_frontend *fe, u8 pwr)
 	return i2c_transfer(d->adapter, msg, 1) == 1 ? 0 : -EIO;
 }
 
+void pt3_mark_read(struct pt3_dma *ts)	/* hand the block back: the FPGA sets both sync bytes again, the last one once it is done */
+{
+	ts->dat[0]				= PTX_TS_NOT_SYNC;
+	ts->dat[ts->sz - PTX_TS_SIZE]	= PTX_TS_NOT_SYNC;
+}
+
 int pt3_dma_run(struct ptx_adap *adap, bool ON)
 {
 	struct pt3_adap	*p	= adap->priv;
@@ -218,9 +290,10 @@ int pt3_dma_run(struct ptx_adap *adap, bool ON)
 	int		i	= 999;
 
 	if (ON) {
-		for (i = 0; i < p->ts_blk_cnt; i++)		/* 17 */
-			*p->ts_info[i].dat	= PTX_TS_NOT_SYNC;
-		p->ts_blk_idx = 0;
+		for (i = 0; i < p->ts_blk_cnt; i++)
+			pt3_mark_read(p->ts_info + i);
+		p->ts_blk_idx	= 0;
+		p->ts_blk_hw	= p->ts_blk_cnt;
 		writel(2, base + PT3_DMA_CTL);			/* stop DMA */
 		writeq(p->desc_info->adr, base + PT3_DMA_DESC);
 		writel(1, base + PT3_DMA_CTL);			/* start DMA */
@@ -241,24 +314,160 @@ int pt3_thread(void *dat)
 	struct pt3_adap	*p	= adap->priv;
 	struct pt3_dma	*ts;
 
+	bool lapped(void)	/* the FPGA finished the block before ts_blk_idx, so it writes ts_blk_idx, still unread */
+	{
+		u32		prev	= (p->ts_blk_idx + p->ts_blk_cnt - 1) % p->ts_blk_cnt;
+		struct pt3_dma	*b	= p->ts_info + prev;
+
+		return prev != p->ts_blk_hw && b->dat[b->sz - PTX_TS_SIZE] == PTX_TS_SYNC;
+	}
+
+	void overrun(u32 lost)	/* ts_blk_idx is the FPGA's now: skip it without touching it */
+	{
+		p->overruns++;
+		p->lost_pkts	+= lost;
+		p->ts_blk_hw	= p->ts_blk_idx;
+		p->ts_blk_idx	= (p->ts_blk_idx + 1) % p->ts_blk_cnt;
+		dev_warn_ratelimited(&adap->card->pdev->dev, "adapter%d: DMA ring overrun #%llu, %llu packets lost",
+				adap->dvb.num, p->overruns, p->lost_pkts);
+	}
+
+	p->blk_ns	= PT3_BLK_NS_INIT;
+	p->blk_last	= ktime_get();
 	set_freezable();
 	while (!kthread_should_stop()) {
-		u32 next = (p->ts_blk_idx + 1) % p->ts_blk_cnt;
+		u32	fill,
+			n;
+		ktime_t	now;
 
 		try_to_freeze();
-		ts = p->ts_info + next;
-		if (*ts->dat != PTX_TS_SYNC) {		/* wait until 1 TS block is full */
-			schedule_timeout_interruptible(0);
+		ptx_wakeup_stat(adap);
+		for (n = 0; n < p->ts_blk_cnt - 1; n++)	/* a block is full once the next one has started */
+			if (*p->ts_info[(p->ts_blk_idx + n + 1) % p->ts_blk_cnt].dat != PTX_TS_SYNC)
+				break;
+		if (!n) {				/* wait until 1 TS block is full */
+			if (delivery) {			/* sleep until it is plausibly full */
+				ktime_t	due	= ktime_add_ns(p->blk_last, p->blk_ns);
+
+				now = ktime_get();
+				if (ktime_compare(due, now) <= 0)
+					due = ktime_add_ns(now, p->blk_ns >> 3);
+				set_current_state(TASK_INTERRUPTIBLE);
+				schedule_hrtimeout_range(&due, p->blk_ns >> 4, HRTIMER_MODE_ABS);
+			} else
+				schedule_timeout_interruptible(0);
 			continue;
 		}
-		ts = p->ts_info + p->ts_blk_idx;
-		dvb_dmx_swfilter_packets(&adap->demux, ts->dat, ts->sz / PTX_TS_SIZE);
-		*ts->dat	= PTX_TS_NOT_SYNC;	/* mark as read */
-		p->ts_blk_idx	= next;
+		now		= ktime_get();
+		p->blk_ns	= (p->blk_ns * 7 + clamp_t(u64, div_u64(ktime_to_ns(ktime_sub(now, p->blk_last)), n),
+						PT3_BLK_NS_MIN, PT3_BLK_NS_MAX)) >> 3;
+		p->blk_last	= now;
+		fill		= n * p->ts_info->sz;
+		trace_ptx_block_ready(adap->dvb.num, p->ts_blk_idx, fill / PTX_TS_SIZE, fill);
+		if (n == p->ts_blk_cnt - 1)		/* the FPGA writes the block read last, ts_blk_idx is next */
+			p->ring_full++;
+		if (lapped()) {				/* torn already, do not deliver it */
+			fill -= p->ts_info[p->ts_blk_idx].sz;
+			overrun(p->ts_info[p->ts_blk_idx].sz / PTX_TS_SIZE);
+			n--;
+		}
+		while (n) {				/* drain all full blocks, one demux call per contiguous run */
+			u32	run	= 1,
+				len;
+
+			ts	= p->ts_info + p->ts_blk_idx;
+			len	= ts->sz;
+			while (run < n && p->ts_blk_idx + run < p->ts_blk_cnt && ts->dat + len == ts[run].dat)
+				len += ts[run++].sz;
+			ptx_filter(adap, ts->dat, len / PTX_TS_SIZE, run, p->ts_blk_idx, fill);
+			fill -= len;
+			if (p->ts_blk_idx == p->ts_blk_hw)	/* delivered after a full lap, ours again */
+				p->ts_blk_hw = p->ts_blk_cnt;
+			if (lapped()) {			/* the FPGA got into the 1st block while it was demuxed, it may be torn */
+				overrun(0);
+				ts++;
+				run--;
+				n--;
+			}
+			for (n -= run; run; run--, ts++)
+				pt3_mark_read(ts);
+			p->ts_blk_idx = (ts - p->ts_info) % p->ts_blk_cnt;
+		}
 	}
 	return 0;
 }
 
+ssize_t ring_blocks_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%u\n", p->ts_blk_cnt);
+}
+
+ssize_t block_bytes_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%u\n", p->ts_info->sz);
+}
+
+ssize_t bitrate_kbps_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+	u64		ns	= p->blk_ns;
+
+	return sprintf(buf, "%llu\n", ns ? div64_u64((u64)p->ts_info->sz * 8 * USEC_PER_SEC, ns) : 0);
+}
+
+ssize_t buffer_ms_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)	/* at current bitrate */
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%llu\n", div_u64(p->blk_ns * p->ts_blk_cnt, NSEC_PER_MSEC));
+}
+
+ssize_t ring_full_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%llu\n", p->ring_full);
+}
+
+ssize_t overruns_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%llu\n", p->overruns);
+}
+
+ssize_t lost_packets_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pt3_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%llu\n", p->lost_pkts);
+}
+
+static struct kobj_attribute	pt3_attr_ring_blocks	= __ATTR_RO(ring_blocks),
+				pt3_attr_block_bytes	= __ATTR_RO(block_bytes),
+				pt3_attr_bitrate_kbps	= __ATTR_RO(bitrate_kbps),
+				pt3_attr_buffer_ms	= __ATTR_RO(buffer_ms),
+				pt3_attr_ring_full	= __ATTR_RO(ring_full),
+				pt3_attr_overruns	= __ATTR_RO(overruns),
+				pt3_attr_lost_packets	= __ATTR_RO(lost_packets);
+static struct attribute *pt3_attrs[] = {
+	&pt3_attr_ring_blocks.attr,
+	&pt3_attr_block_bytes.attr,
+	&pt3_attr_bitrate_kbps.attr,
+	&pt3_attr_buffer_ms.attr,
+	&pt3_attr_ring_full.attr,
+	&pt3_attr_overruns.attr,
+	&pt3_attr_lost_packets.attr,
+	NULL,
+};
+static const struct attribute_group pt3_attr_group = {
+	.attrs	= pt3_attrs,
+};
+
 void pt3_remove(struct pci_dev *pdev)
 {
 	struct ptx_card	*card	= pci_get_drvdata(pdev);
@@ -275,9 +484,13 @@ void pt3_remove(struct pci_dev *pdev)
 		struct pt3_dma	*page;
 		u32		j;
 
+		if (adap->kobj)		/* its attributes read ts_info, freed below */
+			sysfs_remove_group(adap->kobj, &pt3_attr_group);
 		pt3_dma_run(adap, false);
+		if (p->ring.dat)
+			dma_free_attrs(&pdev->dev, p->ring.sz, p->ring.dat, p->ring.adr, DMA_ATTR_NO_WARN);
 		if (p->ts_info) {
-			for (j = 0; j < p->ts_blk_cnt; j++) {
+			for (j = 0; j < p->ts_blk_cnt && !p->ring.dat; j++) {
 				page = &p->ts_info[j];
 				if (page->dat)
 					pci_free_consistent(adap->card->pdev, page->sz, page->dat, page->adr);
@@ -285,7 +498,7 @@ void pt3_remove(struct pci_dev *pdev)
 			kfree(p->ts_info);
 		}
 		if (p->desc_info) {
-			for (j = 0; j < p->desc_pg_cnt; j++) {
+			for (j = 0; j < p->desc_pg_cnt && !p->ring.dat; j++) {
 				page = &p->desc_info[j];
 				if (page->dat)
 					pci_free_consistent(adap->card->pdev, page->sz, page->dat, page->adr);
@@ -314,10 +527,20 @@ int pt3_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 		{0b00010000, TC90522_MODNAME, 0x62, MXL301RF_MODNAME,	{SYS_ISDBT}},
 		{0b00010010, TC90522_MODNAME, 0x61, MXL301RF_MODNAME,	{SYS_ISDBT}},
 	};
-	struct ptx_card	*card	= ptx_alloc(pdev, KBUILD_MODNAME, ARRAY_SIZE(pt3_subdev_info),
+	struct ptx_card	*card	= ptx_alloc(pdev, KBUILD_MODNAME, ARRAY_SIZE(pt3_subdev_info), 64,
 					sizeof(struct pt3_card), sizeof(struct pt3_adap), pt3_lnb);
 
-	bool dma_create(struct pt3_adap	*p)
+	bool dma_get(struct pt3_adap *p, struct pt3_dma *d, u32 off)	/* slice of the ring, or a block of its own */
+	{
+		if (p->ring.dat) {
+			d->dat	= p->ring.dat + off;
+			d->adr	= p->ring.adr + off;
+		} else
+			d->dat	= pci_alloc_consistent(card->pdev, d->sz, &d->adr);
+		return d->dat;
+	}
+
+	bool dma_create(struct pt3_adap	*p, u8 idx)
 	{
 		struct dma_desc {
 			u64 page_addr;
@@ -328,37 +551,39 @@ int pt3_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 			DESC_SZ		= sizeof(struct dma_desc),		/* 20B	*/
 			DESC_MAX	= 4096 / DESC_SZ,			/* 204	*/
 			DESC_PAGE_SZ	= DESC_MAX * DESC_SZ,			/* 4080	*/
-			TS_PAGE_CNT	= PTX_TS_SIZE / 4,			/* 47	*/
-			TS_BLOCK_CNT	= 17,
+			TS_PAGE_CNT	= PTX_TS_SIZE / 4,			/* 47, least pages holding whole TS packets */
 		};
 		struct pt3_dma	*descinfo;
 		struct dma_desc	*prev		= NULL,
 				*curr		= NULL;
 		u32		i,
 				j,
+				ts_pg_cnt	= roundup(clamp_t(u32, ts_blk_pg[idx], TS_PAGE_CNT, TS_PAGE_CNT * 10), TS_PAGE_CNT),
 				desc_todo	= 0,
 				desc_pg_idx	= 0;
 		u64		desc_addr	= 0;
 
-		p->ts_blk_cnt	= TS_BLOCK_CNT;							/* 17	*/
-		p->desc_pg_cnt	= roundup(TS_PAGE_CNT * p->ts_blk_cnt, DESC_MAX);		/* 4	*/
-		p->ts_info	= kcalloc(p->ts_blk_cnt, sizeof(struct pt3_dma), GFP_KERNEL);
-		p->desc_info	= kcalloc(p->desc_pg_cnt, sizeof(struct pt3_dma), GFP_KERNEL);
+		p->ts_blk_cnt	= clamp_t(u32, ts_blk_cnt[idx], 3, 255);				/* 17	*/
+		p->desc_pg_cnt	= DIV_ROUND_UP(ts_pg_cnt * p->ts_blk_cnt, DESC_MAX);		/* 4	*/
+		p->blk_ns	= PT3_BLK_NS_INIT;
+		p->ts_info	= kcalloc_node(p->ts_blk_cnt, sizeof(struct pt3_dma), GFP_KERNEL, dev_to_node(&pdev->dev));
+		p->desc_info	= kcalloc_node(p->desc_pg_cnt, sizeof(struct pt3_dma), GFP_KERNEL, dev_to_node(&pdev->dev));
 		if (!p->ts_info || !p->desc_info)
 			return false;
+		/* TS blocks back to back, then 1 page per descriptor table; CMA-backed where configured */
+		p->ring.sz	= ALIGN(DESC_PAGE_SZ * ts_pg_cnt * p->ts_blk_cnt, 4096) + 4096 * p->desc_pg_cnt;
+		p->ring.dat	= dma_alloc_attrs(&pdev->dev, p->ring.sz, &p->ring.adr, GFP_KERNEL, DMA_ATTR_NO_WARN);
 		for (i = 0; i < p->desc_pg_cnt; i++) {						/* 4	*/
 			p->desc_info[i].sz	= DESC_PAGE_SZ;					/* 4080B, max 204 * 4 = 816 descs */
-			p->desc_info[i].dat	= pci_alloc_consistent(card->pdev, p->desc_info[i].sz, &p->desc_info[i].adr);
-			if (!p->desc_info[i].dat)
+			if (!dma_get(p, p->desc_info + i, p->ring.sz - 4096 * (p->desc_pg_cnt - i)))
 				return false;
 			memset(p->desc_info[i].dat, 0, p->desc_info[i].sz);
 		}
 		for (i = 0; i < p->ts_blk_cnt; i++) {						/* 17	*/
-			p->ts_info[i].sz	= DESC_PAGE_SZ * TS_PAGE_CNT;			/* 1020 pkts, 4080 * 47 = 191760B, total 3259920B */
-			p->ts_info[i].dat	= pci_alloc_consistent(card->pdev, p->ts_info[i].sz, &p->ts_info[i].adr);
-			if (!p->ts_info[i].dat)
+			p->ts_info[i].sz	= DESC_PAGE_SZ * ts_pg_cnt;			/* 1020 pkts, 4080 * 47 = 191760B, total 3259920B */
+			if (!dma_get(p, p->ts_info + i, p->ts_info[i].sz * i))
 				return false;
-			for (j = 0; j < TS_PAGE_CNT; j++) {					/* 47, total 47 * 17 = 799 pages */
+			for (j = 0; j < ts_pg_cnt; j++) {					/* 47, total 47 * 17 = 799 pages */
 				if (!desc_todo) {						/* 20	*/
 					descinfo	= p->desc_info + desc_pg_idx;		/* jump to next desc_pg */
 					curr		= (struct dma_desc *)descinfo->dat;
@@ -400,7 +625,7 @@ int pt3_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 		struct pt3_adap	*p	= adap->priv;
 
 		p->dma_base	= c->bar_reg + PT3_DMA_BASE + PT3_DMA_OFFSET * i;
-		if (!dma_create(p))
+		if (!dma_create(p, i))
 			return ptx_abort(pdev, pt3_remove, -ENOMEM, "Failed dma_create");
 	}
 	adap--;
@@ -410,15 +635,58 @@ int pt3_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 		pt3_power(adap->fe, PT3_PWR_TUNER_ON)					||
 		pt3_i2c_flush(c, PT3_I2C_START_ADDR)					||
 		pt3_power(adap->fe, PT3_PWR_TUNER_ON | PT3_PWR_AMP_ON);
-	return	ret ?
-		ptx_abort(pdev, pt3_remove, ret, "Unable to register I2C/DVB adapter/frontend") :
-		0;
+	if (ret)
+		return ptx_abort(pdev, pt3_remove, ret, "Unable to register I2C/DVB adapter/frontend");
+	for (i = 0, adap = card->adap; i < card->adapn; i++, adap++) {
+		struct pt3_adap	*p	= adap->priv;
+
+		debugfs_create_u64("blk_ns",	0444, adap->dbgfs, &p->blk_ns);
+		debugfs_create_u64("ring_full",	0444, adap->dbgfs, &p->ring_full);
+		debugfs_create_u64("overruns",	0444, adap->dbgfs, &p->overruns);
+		debugfs_create_u64("lost_pkts",	0444, adap->dbgfs, &p->lost_pkts);
+		if (sysfs_create_group(adap->kobj, &pt3_attr_group))
+			return ptx_abort(pdev, pt3_remove, -ENOMEM, "Failed sysfs_create_group");
+		dev_info(&pdev->dev, "adapter%d: DMA ring %u x %uB, %s", adap->dvb.num, p->ts_blk_cnt, p->ts_info->sz,
+			p->ring.dat ? "contiguous" : "scattered");
+	}
+	return 0;
+}
+
+int pt3_suspend(struct device *dev)
+{
+	struct ptx_card	*card	= dev_get_drvdata(dev);
+
+	ptx_suspend(card);
+	pt3_power(card->adap[card->adapn - 1].fe, PT3_PWR_OFF);
+	return 0;
 }
 
+int pt3_resume(struct device *dev)	/* FPGA lost its state, DMA rings & descriptor chains are still in place */
+{
+	struct ptx_card		*card	= dev_get_drvdata(dev);
+	struct pt3_card		*c	= card->priv;
+	struct dvb_frontend	*fe	= card->adap[card->adapn - 1].fe;
+	int	ret =	pt3_i2c_flush(c, 0)					||
+			pt3_power(fe, PT3_PWR_TUNER_ON)				||
+			pt3_i2c_flush(c, PT3_I2C_START_ADDR)			||
+			pt3_power(fe, PT3_PWR_TUNER_ON | PT3_PWR_AMP_ON);
+
+	if (ret) {
+		dev_err(dev, "resume failed, reload the driver");
+		return -EIO;
+	}
+	pt3_lnb(card, false);			/* lnbON was cleared as the frontends went to sleep */
+	return ptx_resume(card);
+}
+
+static SIMPLE_DEV_PM_OPS(pt3_pm_ops, pt3_suspend, pt3_resume);
+
 static struct pci_driver pt3_driver = {
 	.name		= KBUILD_MODNAME,
 	.id_table	= pt3_id,
 	.probe		= pt3_probe,
 	.remove		= pt3_remove,
+	.driver.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
+	.driver.pm	= &pt3_pm_ops,
 };
 module_pci_driver(pt3_driver);
\ No newline at end of file
@@ -4,12 +4,23 @@
 	Copyright (C) Budi Rachmanto, AreMa Inc. <info@are.ma>
 */
 
+#include <linux/async.h>
+#include <linux/seq_file.h>
+#include <uapi/linux/sched/types.h>
 #include "ptx_common.h"
+#include "ptx_trace.h"
 
 MODULE_AUTHOR(PTX_AUTH);
 MODULE_DESCRIPTION("Common DVB registration procedures");
 MODULE_LICENSE("GPL");
 
+static char *cpus = "";
+module_param(cpus, charp, 0444);
+MODULE_PARM_DESC(cpus, "CPU list for the adapter kthreads (default: CPUs of the device NUMA node)");
+static int rt_prio;
+module_param(rt_prio, int, 0444);
+MODULE_PARM_DESC(rt_prio, "SCHED_FIFO priority of the adapter kthreads (0:SCHED_NORMAL, default, 1-99)");
+
 void ptx_lnb(struct ptx_card *card)
 {
 	struct ptx_adap	*adap;
@@ -45,38 +56,132 @@ int ptx_wakeup(struct dvb_frontend *fe)
 	return adap->fe_wakeup ? adap->fe_wakeup(fe) : 0;
 }
 
-int ptx_stop_feed(struct dvb_demux_feed *feed)
+void ptx_suspend(struct ptx_card *card)	/* kthreads are frozen, DMA buffers & descriptors are kept */
+{
+	struct ptx_adap	*adap;
+	int		i,
+			err;
+
+	for (i = 0, adap = card->adap; i < card->adapn && adap->fe; i++, adap++) {
+		if (adap->feeds) {
+			err = card->dma(adap, false);
+			trace_ptx_dma(adap->dvb.num, false, err);
+			if (err)
+				dev_warn(card->dev, "adapter%d: DMA stop failed (%d)", adap->dvb.num, err);
+		}
+		adap->resume = adap->ON;
+		if (adap->ON)
+			dvb_frontend_suspend(adap->fe);
+	}
+}
+
+int ptx_resume(struct ptx_card *card)	/* bridge registers already restored, the chips behind it lost power */
+{
+	struct ptx_adap	*adap;
+	int		i,
+			err,
+			ret	= 0;
+
+	for (i = 0, adap = card->adap; i < card->adapn && adap->fe; i++, adap++) {	/* all of them, 1st error returned */
+		struct dvb_tuner_ops	*t	= &adap->fe->ops.tuner_ops;
+
+		err = 0;
+		if (adap->resume)
+			err = dvb_frontend_resume(adap->fe);	/* power up, then the frontend thread re-tunes */
+		else if (t->resume) {				/* back to the state probe left it in */
+			err = t->resume(adap->fe);
+			if (t->sleep)
+				t->sleep(adap->fe);
+			ptx_sleep(adap->fe);
+		}
+		if (err) {
+			dev_err(card->dev, "adapter%d: frontend resume failed (%d)", adap->dvb.num, err);
+			ret = ret ? ret : err;
+		}
+		adap->resume = false;
+		if (!adap->feeds)
+			continue;
+		err = card->dma(adap, true);
+		trace_ptx_dma(adap->dvb.num, true, err);
+		if (err) {
+			dev_err(card->dev, "adapter%d: DMA restart failed (%d)", adap->dvb.num, err);
+			ret = ret ? ret : err;
+		}
+	}
+	return ret;
+}
+
+void ptx_sched(struct ptx_adap *adap)	/* apply affinity & policy to the running kthread */
+{
+	struct sched_attr	attr	= {
+		.sched_policy	= adap->rt_prio ? SCHED_FIFO : SCHED_NORMAL,
+		.sched_priority	= adap->rt_prio,
+	};
+
+	if (!adap->kthread)
+		return;
+	if (set_cpus_allowed_ptr(adap->kthread, adap->cpus) || sched_setattr_nocheck(adap->kthread, &attr))
+		dev_warn(adap->card->dev, "adapter%d: unable to set kthread CPUs %*pbl / priority %d",
+			adap->dvb.num, cpumask_pr_args(adap->cpus), adap->rt_prio);
+}
+
+int ptx_stop_feed(struct dvb_demux_feed *feed)	/* under demux->mutex */
 {
 	struct ptx_adap	*adap	= container_of(feed->demux, struct ptx_adap, demux);
+	int		err;
 
-	adap->card->dma(adap, false);
+	if (!adap->feeds || --adap->feeds)	/* other filters still use the stream */
+		return 0;
+	err = adap->card->dma(adap, false);
+	trace_ptx_dma(adap->dvb.num, false, err);
 	if (adap->kthread)
 		kthread_stop(adap->kthread);
+	adap->kthread = NULL;
 	return 0;
 }
 
-int ptx_start_feed(struct dvb_demux_feed *feed)
+int ptx_start_feed(struct dvb_demux_feed *feed)	/* under demux->mutex */
 {
 	struct ptx_adap	*adap	= container_of(feed->demux, struct ptx_adap, demux);
+	int		err;
 
-	if (adap->card->thread)
-		adap->kthread = kthread_run(adap->card->thread, adap, "%s_%d%c", adap->dvb.name, adap->dvb.num,
+	if (adap->feeds++)			/* stream already running */
+		return 0;
+	if (adap->card->thread) {
+		adap->kthread = kthread_create(adap->card->thread, adap, "%s_%d%c", adap->dvb.name, adap->dvb.num,
 					adap->fe->dtv_property_cache.delivery_system == SYS_ISDBS ? 's' :
 					adap->fe->dtv_property_cache.delivery_system == SYS_ISDBT ? 't' : 'u');
-	return IS_ERR(adap->kthread) ? PTR_ERR(adap->kthread) : adap->card->dma(adap, true);
+		if (IS_ERR(adap->kthread)) {
+			err		= PTR_ERR(adap->kthread);
+			adap->kthread	= NULL;
+			adap->feeds	= 0;
+			return err;
+		}
+		ptx_sched(adap);
+	}
+	err = adap->card->dma(adap, true);	/* before the consumer runs: it may reset the ring indices */
+	trace_ptx_dma(adap->dvb.num, true, err);
+	if (err) {
+		if (adap->kthread)
+			kthread_stop(adap->kthread);
+		adap->kthread	= NULL;
+		adap->feeds	= 0;
+	} else if (adap->kthread)
+		wake_up_process(adap->kthread);
+	return err;
 }
 
-struct ptx_card *ptx_alloc(struct pci_dev *pdev, u8 *name, u8 adapn, u32 sz_card_priv, u32 sz_adap_priv,
+struct ptx_card *ptx_alloc_dev(struct device *dev, u8 *name, u8 adapn, u32 sz_card_priv, u32 sz_adap_priv,
 			void (*lnb)(struct ptx_card *, bool))
 {
 	u8 i;
-	struct ptx_card *card = kzalloc(sizeof(struct ptx_card) + sz_card_priv
-					+ adapn * (sizeof(struct ptx_adap) + sz_adap_priv), GFP_KERNEL);
+	struct ptx_card *card = kzalloc_node(sizeof(struct ptx_card) + sz_card_priv
+					+ adapn * (sizeof(struct ptx_adap) + sz_adap_priv), GFP_KERNEL, dev_to_node(dev));
 	if (!card)
 		return NULL;
 	card->priv	= sz_card_priv ? &card[1] : NULL;
 	card->adap	= (struct ptx_adap *)((u8 *)&card[1] + sz_card_priv);
-	card->pdev	= pdev;
+	card->dev	= dev;
 	card->adapn	= adapn;
 	card->name	= name;
 	card->lnbON	= true;
@@ -87,14 +192,27 @@ struct ptx_card *ptx_alloc(struct pci_dev *pdev, u8 *name, u8 adapn, u32 sz_card
 		p->card	= card;
 		p->priv	= sz_adap_priv ? (u8 *)&card->adap[adapn] + i * sz_adap_priv : NULL;
 	}
-	if (pci_enable_device(pdev)					||
-		pci_set_dma_mask(pdev, DMA_BIT_MASK(32))		||
-		pci_set_consistent_dma_mask(pdev, DMA_BIT_MASK(32))	||
+	dev_set_drvdata(dev, card);
+	return card;
+}
+
+struct ptx_card *ptx_alloc(struct pci_dev *pdev, u8 *name, u8 adapn, u8 dma_bits, u32 sz_card_priv, u32 sz_adap_priv,
+			void (*lnb)(struct ptx_card *, bool))	/* dma_bits: device addressing, falls back to 32 */
+{
+	struct ptx_card *card = ptx_alloc_dev(&pdev->dev, name, adapn, sz_card_priv, sz_adap_priv, lnb);
+
+	if (!card)
+		return NULL;
+	card->pdev	= pdev;
+	if (pci_enable_device(pdev)								||
+		(dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(dma_bits))	&&
+		dma_set_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(32)))			||
 		pci_request_regions(pdev, name)) {
+		pci_set_drvdata(pdev, NULL);
 		kfree(card);
 		return NULL;
 	}
-	pci_set_drvdata(pdev, card);
+	dev_info(&pdev->dev, "%d-bit DMA", fls64(dma_get_mask(&pdev->dev)));
 	return card;
 }
 
@@ -103,7 +221,7 @@ int ptx_i2c_add_adapter(struct ptx_card *card, const struct i2c_algorithm *algo)
 	struct i2c_adapter *i2c = &card->i2c;
 
 	i2c->algo	= algo;
-	i2c->dev.parent	= &card->pdev->dev;
+	i2c->dev.parent	= card->dev;
 	strcpy(i2c->name, card->name);
 	i2c_set_adapdata(i2c, card);
 	mutex_init(&card->lock);
@@ -129,7 +247,7 @@ void ptx_register_subdev(struct i2c_adapter *i2c, struct dvb_frontend *fe, u16 a
 
 	strlcpy(info.type, name, I2C_NAME_SIZE);
 	pr_info("%s %s", __func__, info.type);
-	if (request_module("%s", info.type) < 0) {
+	if (!current_is_async() && request_module("%s", info.type) < 0) {	/* async: must not wait for modprobe, see MODULE_SOFTDEP */
 		pr_err("%s ERROR request_module %s", __func__, info.type);
 		return;
 	}
@@ -162,11 +280,15 @@ struct dvb_frontend *ptx_register_fe(struct i2c_adapter *i2c, struct dvb_adapter
 
 	if (!dvb || !info || !(fe = kzalloc(sizeof(struct dvb_frontend), GFP_KERNEL)))
 		return	NULL;
-	ptx_register_subdev(i2c, fe, info->demod_addr, info->demod_name);
-	ptx_register_subdev(i2c, fe, info->tuner_addr, info->tuner_name);
+	if (info->ops)
+		fe->ops = *info->ops;
+	else {
+		ptx_register_subdev(i2c, fe, info->demod_addr, info->demod_name);
+		ptx_register_subdev(i2c, fe, info->tuner_addr, info->tuner_name);
+	}
 	for (i = 0; i < MAX_DELSYS; i++)
 		fe->ops.delsys[i] = info->delsys[i];
-	if (!fe->demodulator_priv || !fe->tuner_priv || (dvb && dvb_register_frontend(dvb, fe))) {
+	if ((!info->ops && (!fe->demodulator_priv || !fe->tuner_priv)) || (dvb && dvb_register_frontend(dvb, fe))) {
 		ptx_unregister_fe(fe);
 		return	NULL;
 	}
@@ -178,7 +300,10 @@ void ptx_unregister_adap(struct ptx_card *card)
 	int		i	= card->adapn - 1;
 	struct ptx_adap	*adap	= card->adap + i;
 
+	debugfs_remove_recursive(card->dbgfs);
 	for (; i >= 0; i--, adap--) {
+		kobject_put(adap->kobj);
+		free_cpumask_var(adap->cpus);
 		ptx_unregister_fe(adap->fe);
 		if (adap->demux.dmx.close)
 			adap->demux.dmx.close(&adap->demux.dmx);
@@ -189,66 +314,278 @@ void ptx_unregister_adap(struct ptx_card *card)
 		if (adap->dvb.name)
 			dvb_unregister_adapter(&adap->dvb);
 	}
-	i2c_del_adapter(&card->i2c);
-	pci_release_regions(card->pdev);
-	pci_set_drvdata(card->pdev, NULL);
-	pci_disable_device(card->pdev);
+	if (card->i2c.algo)
+		i2c_del_adapter(&card->i2c);
+	if (card->pdev) {
+		pci_release_regions(card->pdev);
+		pci_disable_device(card->pdev);
+	}
+	dev_set_drvdata(card->dev, NULL);
 	kfree(card);
 }
 
+void ptx_wakeup_stat(struct ptx_adap *adap)
+{
+	u64_stats_update_begin(&adap->stats.syncp);
+	adap->stats.wakeups++;
+	u64_stats_update_end(&adap->stats.syncp);
+}
+
+void ptx_account(struct ptx_adap *adap, u32 bytes, u32 blocks, u32 tei, u32 lost, u64 ns, u32 fill)
+{
+	struct ptx_stats	*st	= &adap->stats;
+
+	u64_stats_update_begin(&st->syncp);
+	st->bytes	+= bytes;
+	st->pkts	+= bytes / PTX_TS_SIZE;
+	st->blocks	+= blocks;
+	st->tei		+= tei;
+	st->sync_loss	+= lost;
+	st->filter_ns	+= ns;
+	if (st->fill_hwm < fill)
+		st->fill_hwm = fill;
+	u64_stats_update_end(&st->syncp);
+}
+
+void ptx_filter(struct ptx_adap *adap, const u8 *buf, u32 cnt, u32 blocks, u32 idx, u32 fill)	/* cnt TS packets to the demux */
+{
+	const u8	*ts	= buf;
+	u32		tei	= 0,
+			lost	= 0,
+			i;
+	u64		t	= ktime_get_ns();
+
+	for (i = 0; i < cnt; i++, ts += PTX_TS_SIZE) {
+		lost	+= ts[0] != PTX_TS_SYNC;
+		tei	+= ts[1] >> 7;
+	}
+	dvb_dmx_swfilter_packets(&adap->demux, buf, cnt);
+	t = ktime_get_ns() - t;
+	trace_ptx_block_consumed(adap->dvb.num, idx, cnt, fill);
+	ptx_account(adap, cnt * PTX_TS_SIZE, blocks, tei, lost, t, fill);
+}
+
+void ptx_filter_raw(struct ptx_adap *adap, const u8 *buf, u32 len, u32 blocks, u32 idx, u32 fill)	/* unaligned byte stream */
+{
+	u64	t	= ktime_get_ns();
+
+	dvb_dmx_swfilter(&adap->demux, buf, len);	/* resyncs on 0x47, skips partial & non-188B records */
+	t = ktime_get_ns() - t;
+	trace_ptx_block_consumed(adap->dvb.num, idx, len / PTX_TS_SIZE, fill);
+	ptx_account(adap, len, blocks, 0, 0, t, fill);
+}
+
+int ptx_stats_show(struct seq_file *m, void *v)
+{
+	struct ptx_adap		*adap	= m->private;
+	struct ptx_stats	st;
+	unsigned int		seq;
+
+	do {
+		seq	= u64_stats_fetch_begin(&adap->stats.syncp);
+		st	= adap->stats;
+	} while (u64_stats_fetch_retry(&adap->stats.syncp, seq));
+	seq_printf(m, "bytes\t\t%llu\npackets\t\t%llu\nblocks\t\t%llu\ntei\t\t%llu\nsync_loss\t%llu\n",
+		st.bytes, st.pkts, st.blocks, st.tei, st.sync_loss);
+	seq_printf(m, "fill_hwm\t%u\nwakeups\t\t%llu\nfilter_ns\t%llu\n", st.fill_hwm, st.wakeups, st.filter_ns);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ptx_stats);
+
+ssize_t cpus_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct ptx_adap	*adap	= ptx_kobj2adap(kobj);
+
+	return sprintf(buf, "%*pbl\n", cpumask_pr_args(adap->cpus));
+}
+
+ssize_t cpus_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct ptx_adap	*adap	= ptx_kobj2adap(kobj);
+	cpumask_var_t	mask;
+	int		err;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+	err = cpulist_parse(buf, mask);
+	if (!err && !cpumask_intersects(mask, cpu_online_mask))
+		err = -EINVAL;
+	if (!err) {
+		mutex_lock(&adap->demux.mutex);		/* vs. kthread start/stop */
+		cpumask_copy(adap->cpus, mask);
+		ptx_sched(adap);
+		mutex_unlock(&adap->demux.mutex);
+	}
+	free_cpumask_var(mask);
+	return err ? err : count;
+}
+
+ssize_t rt_prio_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ptx_kobj2adap(kobj)->rt_prio);
+}
+
+ssize_t rt_prio_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	struct ptx_adap	*adap	= ptx_kobj2adap(kobj);
+	int		prio,
+			err	= kstrtoint(buf, 0, &prio);
+
+	if (err)
+		return err;
+	if (prio < 0 || prio >= MAX_RT_PRIO)
+		return -ERANGE;
+	mutex_lock(&adap->demux.mutex);
+	adap->rt_prio = prio;
+	ptx_sched(adap);
+	mutex_unlock(&adap->demux.mutex);
+	return count;
+}
+
+static struct kobj_attribute ptx_attr_cpus	= __ATTR_RW(cpus);
+static struct kobj_attribute ptx_attr_rt_prio	= __ATTR_RW(rt_prio);
+
+static struct attribute *ptx_attrs[] = {
+	&ptx_attr_cpus.attr,
+	&ptx_attr_rt_prio.attr,
+	NULL,
+};
+
+static const struct attribute_group ptx_attr_group = {
+	.attrs = ptx_attrs,
+};
+
 DVB_DEFINE_MOD_OPT_ADAPTER_NR(adap_no);
+
+struct ptx_fe_job {
+	struct ptx_adap			*adap;
+	const struct ptx_subdev_info	*info;
+	s64				dvb_us,
+					fe_us;
+};
+
+void ptx_register_fe_async(void *dat, async_cookie_t cookie)	/* demod & tuner probe of 1 adapter, in parallel with the others */
+{
+	struct ptx_fe_job	*job	= dat;
+	ktime_t			t	= ktime_get();
+
+	job->adap->fe	= ptx_register_fe(&job->adap->card->i2c, &job->adap->dvb, job->info);
+	job->fe_us	= ktime_us_delta(ktime_get(), t);
+}
+
 int ptx_register_adap(struct ptx_card *card, const struct ptx_subdev_info *info,
 			int (*thread)(void *), int (*dma)(struct ptx_adap *, bool))
 {
+	ASYNC_DOMAIN_EXCLUSIVE(fe_domain);
+	struct ptx_fe_job	job[PTX_ADAP_MAX];
 	struct ptx_adap	*adap;
 //	short	adap_no[DVB_MAX_ADAPTERS] = {};
+	char	name[32];
+	int	node	= card ? dev_to_node(card->dev) : NUMA_NO_NODE;
 	u8	i;
+	ktime_t	t0	= ktime_get();
+
+	void load(u8 n, u8 *mod)	/* once per module: modprobe is slow even for a loaded module */
+	{
+		u8	j;
+
+		for (j = 0; j < n; j++)
+			if (!info[j].ops && (!strcmp((char *)info[j].demod_name, (char *)mod) ||
+						!strcmp((char *)info[j].tuner_name, (char *)mod)))
+				return;
+		if (request_module("%s", mod) < 0)
+			dev_warn(card->dev, "request_module %s failed", mod);
+	}
+
+	int fail(int err)		/* jobs point into this stack frame */
+	{
+		async_synchronize_full_domain(&fe_domain);
+		return err;
+	}
 
 	if (!card || !info)
 		return -EFAULT;
-	if (card->adapn > DVB_MAX_ADAPTERS)
+	if (card->adapn > PTX_ADAP_MAX)
 		return -ERANGE;
 	card->thread	= thread;
 	card->dma	= dma;
-	for (i = 0, adap = card->adap; i < card->adapn; i++, adap++) {
+	for (i = 0; i < card->adapn && !current_is_async(); i++)	/* async probe: MODULE_SOFTDEP loaded them */
+		if (!info[i].ops) {
+			load(i, info[i].demod_name);
+			load(i, info[i].tuner_name);
+		}
+	snprintf(name, sizeof(name), "%s-%s", card->name, dev_name(card->dev));
+	card->dbgfs	= debugfs_create_dir(name, NULL);
+	for (i = 0, adap = card->adap; i < card->adapn; i++, adap++) {	/* in order: adapter numbers */
 		struct dvb_adapter	*dvb	= &adap->dvb;
 		struct dvb_demux	*demux	= &adap->demux;
 		struct dmxdev		*dmxdev	= &adap->dmxdev;
+		ktime_t			t	= ktime_get();
 		int	err,
 			num;
 
-		num = dvb_register_adapter(dvb, card->name, THIS_MODULE, &card->pdev->dev, adap_no);
+		num = dvb_register_adapter(dvb, card->name, THIS_MODULE, card->dev, adap_no);
 		if (num < 0) {
 			pr_err("%s DVB_MAX_ADAPTERS=%d, please increase it!", __func__, DVB_MAX_ADAPTERS);
-			return -ENFILE;
+			return fail(-ENFILE);
 		}
 		demux->dmx.capabilities = DMX_TS_FILTERING | DMX_SECTION_FILTERING;
-		demux->feednum		= 1;
-		demux->filternum	= 1;
+		demux->feednum		= PTX_FEED_MAX;
+		demux->filternum	= PTX_FEED_MAX;
 		demux->start_feed	= ptx_start_feed;
 		demux->stop_feed	= ptx_stop_feed;
 		if (dvb_dmx_init(demux) < 0)
-			return -ENOMEM;
-		dmxdev->filternum	= 1;
+			return fail(-ENOMEM);
+		dmxdev->filternum	= PTX_FEED_MAX;
 		dmxdev->demux		= &demux->dmx;
 		err			= dvb_dmxdev_init(dmxdev, dvb);
 		if (err)
-			return err;
-		adap->fe		= ptx_register_fe(&adap->card->i2c, &adap->dvb, &info[i]);
+			return fail(err);
+		job[i] = (struct ptx_fe_job){.adap = adap, .info = info + i, .dvb_us = ktime_us_delta(ktime_get(), t)};
+		async_schedule_domain(ptx_register_fe_async, job + i, &fe_domain);
+	}
+	async_synchronize_full_domain(&fe_domain);
+	for (i = 0, adap = card->adap; i < card->adapn; i++, adap++) {
 		if (!adap->fe)
 			return -ENOMEM;
 		adap->fe_sleep		= adap->fe->ops.sleep;
 		adap->fe_wakeup		= adap->fe->ops.init;
 		adap->fe->ops.sleep	= ptx_sleep;
 		adap->fe->ops.init	= ptx_wakeup;
-		pr_info("%s %s:%d:%s adapter %d", __func__, card->name, i,
+		pr_info("%s %s:%d:%s adapter %d: dvb %lldus, frontend %lldus", __func__, card->name, i,
 			adap->fe->dtv_property_cache.delivery_system == SYS_ISDBS ? "ISDBS" :
-			adap->fe->dtv_property_cache.delivery_system == SYS_ISDBT ? "ISDBT" : "UNKNOWN", num);
+			adap->fe->dtv_property_cache.delivery_system == SYS_ISDBT ? "ISDBT" : "UNKNOWN", adap->dvb.num,
+			job[i].dvb_us, job[i].fe_us);
+		snprintf(name, sizeof(name), "adapter%d", adap->dvb.num);
+		adap->dbgfs		= debugfs_create_dir(name, card->dbgfs);
+		u64_stats_init(&adap->stats.syncp);
+		debugfs_create_file("stats", 0444, adap->dbgfs, adap, &ptx_stats_fops);
+		adap->kobj		= kobject_create_and_add(name, &card->dev->kobj);
+		if (!adap->kobj || !zalloc_cpumask_var(&adap->cpus, GFP_KERNEL))
+			return -ENOMEM;
+		if (!*cpus || cpulist_parse(cpus, adap->cpus) || !cpumask_intersects(adap->cpus, cpu_online_mask))
+			cpumask_copy(adap->cpus, node == NUMA_NO_NODE || !cpumask_intersects(cpumask_of_node(node), cpu_online_mask) ?
+					cpu_online_mask : cpumask_of_node(node));	/* next to the DMA buffers */
+		adap->rt_prio		= clamp(rt_prio, 0, MAX_RT_PRIO - 1);
+		if (sysfs_create_group(adap->kobj, &ptx_attr_group))
+			return -ENOMEM;
 		ptx_sleep(adap->fe);
 	}
+	dev_info(card->dev, "%d adapters registered in %lldus", card->adapn, ktime_us_delta(ktime_get(), t0));
 	return 0;
 }
 
+struct ptx_adap *ptx_kobj2adap(struct kobject *kobj)	/* sysfs adapterN -> ptx_adap */
+{
+	struct ptx_card	*card	= dev_get_drvdata(kobj_to_dev(kobj->parent));
+	int		i;
+
+	for (i = 0; i < card->adapn; i++)
+		if (card->adap[i].kobj == kobj)
+			return &card->adap[i];
+	return NULL;
+}
+
 int ptx_abort(struct pci_dev *pdev, void remover(struct pci_dev *), int err, char *fmt, ...)
 {
 	va_list	ap;
@@ -12,9 +12,11 @@
 #ifndef	PTX_COMMON_H
 #define PTX_COMMON_H
 
+#include <linux/debugfs.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
 #include <linux/pci.h>
+#include <linux/u64_stats_sync.h>
 #include <media/dvb_demux.h>
 #include <media/dvb_frontend.h>
 #include <media/dmxdev.h>
@@ -25,19 +27,36 @@ enum ePTX {
 	PTX_TS_SIZE	= 188,
 	PTX_TS_SYNC	= 0x47,
 	PTX_TS_NOT_SYNC	= 0x74,
+	PTX_FEED_MAX	= 256,	/* PID/section filters per adapter sharing 1 stream */
+	PTX_ADAP_MAX	= 8,	/* adapters per card, PX-Q3PE has the most */
 };
 
 struct ptx_subdev_info {
 	u8	demod_addr,	*demod_name,
 		tuner_addr,	*tuner_name;
 	enum fe_delivery_system	delsys[MAX_DELSYS];
+	const struct dvb_frontend_ops	*ops;	/* built-in frontend, no I2C subdevices */
+};
+
+struct ptx_stats {		/* written by the adapter kthread only */
+	struct u64_stats_sync	syncp;
+	u64	bytes,
+		pkts,
+		blocks,
+		tei,		/* transport_error_indicator set	*/
+		sync_loss,	/* not starting with PTX_TS_SYNC	*/
+		wakeups,
+		filter_ns;	/* time spent in dvb_dmx_swfilter*	*/
+	u32	fill_hwm;	/* ring fill high-water mark, bytes	*/
 };
 
 struct ptx_card {
 	struct ptx_adap		*adap;
 	struct mutex		lock;
 	struct i2c_adapter	i2c;
-	struct pci_dev		*pdev;
+	struct pci_dev		*pdev;	/* NULL for non-PCI bridges */
+	struct device		*dev;
+	struct dentry		*dbgfs;
 	u8	*name,
 		adapn;
 	bool	lnbON;
@@ -49,27 +68,42 @@ struct ptx_card {
 
 struct ptx_adap {
 	struct ptx_card		*card;
-	bool			ON;
+	bool			ON,
+				resume;	/* was ON at suspend, re-tuned on resume */
 	struct dvb_adapter	dvb;
 	struct dvb_demux	demux;
 	struct dmxdev		dmxdev;
 	struct dvb_frontend	*fe;
 	struct task_struct	*kthread;
+	u32			feeds;	/* active demux feeds, DMA & kthread run while > 0 */
+	cpumask_var_t		cpus;	/* kthread affinity */
+	int			rt_prio;	/* kthread SCHED_FIFO priority, 0:SCHED_NORMAL */
+	struct ptx_stats	stats;
+	struct dentry		*dbgfs;
+	struct kobject		*kobj;
 	void			*priv;
 	int	(*fe_sleep)(struct dvb_frontend *),
 		(*fe_wakeup)(struct dvb_frontend *);
 };
 
-struct ptx_card *ptx_alloc(struct pci_dev *pdev, u8 *name, u8 adapn, u32 sz_card_priv, u32 sz_adap_priv,
+struct ptx_card *ptx_alloc_dev(struct device *dev, u8 *name, u8 adapn, u32 sz_card_priv, u32 sz_adap_priv,
+			void (*lnb)(struct ptx_card *, bool));
+struct ptx_card *ptx_alloc(struct pci_dev *pdev, u8 *name, u8 adapn, u8 dma_bits, u32 sz_card_priv, u32 sz_adap_priv,
 			void (*lnb)(struct ptx_card *, bool));
 int ptx_sleep(struct dvb_frontend *fe);
 int ptx_wakeup(struct dvb_frontend *fe);
+void ptx_suspend(struct ptx_card *card);
+int ptx_resume(struct ptx_card *card);
 int ptx_i2c_add_adapter(struct ptx_card *card, const struct i2c_algorithm *algo);
 void ptx_unregister_fe(struct dvb_frontend *fe);
 struct dvb_frontend *ptx_register_fe(struct i2c_adapter *i2c, struct dvb_adapter *dvb, const struct ptx_subdev_info *info);
 void ptx_unregister_adap(struct ptx_card *card);
 int ptx_register_adap(struct ptx_card *card, const struct ptx_subdev_info *info,
 			int (*thread)(void *), int (*dma)(struct ptx_adap *, bool));
+struct ptx_adap *ptx_kobj2adap(struct kobject *kobj);
+void ptx_wakeup_stat(struct ptx_adap *adap);
+void ptx_filter(struct ptx_adap *adap, const u8 *buf, u32 cnt, u32 blocks, u32 idx, u32 fill);
+void ptx_filter_raw(struct ptx_adap *adap, const u8 *buf, u32 len, u32 blocks, u32 idx, u32 fill);
 int ptx_abort(struct pci_dev *pdev, void remover(struct pci_dev *), int err, char *fmt, ...);
 u32 ptx_i2c_func(struct i2c_adapter *i2c);
 
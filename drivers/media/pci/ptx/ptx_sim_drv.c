@@ -0,0 +1,276 @@
+/*
+	Simulated ISDB-S/T bridge for the PTX DVB drivers, no hardware required
+
+	Feeds a synthetic or file-backed TS at a fixed bitrate through the same
+	ptx_common kthread + dvb_demux path used by PT3 & PX-Q3PE.
+
+	Synthetic packets are sent on a single PID with a running continuity counter.
+	Their payload starts with 2 little-endian u64: a packet sequence number and
+	the ktime_get_ns() timestamp at which the packet was handed to the demux.
+
+	Copyright (C) Budi Rachmanto, AreMa Inc. <info@are.ma>
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+*/
+
+#include <linux/platform_device.h>
+#include <asm/unaligned.h>
+#include "ptx_common.h"
+#define PTX_TRACE_SYSTEM ptx_sim
+#define CREATE_TRACE_POINTS
+#include "ptx_trace.h"
+
+MODULE_AUTHOR(PTX_AUTH);
+MODULE_DESCRIPTION("Simulated ISDB-S/T DVB bridge");
+MODULE_LICENSE("GPL");
+
+enum ePTX_SIM {
+	PTX_SIM_ADAP_MAX	= PTX_ADAP_MAX,
+	PTX_SIM_BLK_MAX		= 16,	/* backlog in blocks before packets are dropped, as a full DMA ring would */
+};
+
+static int adapters = 4;
+module_param(adapters, int, 0444);
+MODULE_PARM_DESC(adapters, "number of adapters, even:ISDB-S odd:ISDB-T (1-8, default 4)");
+static int bitrate_kbps = 32000;
+module_param(bitrate_kbps, int, 0644);
+MODULE_PARM_DESC(bitrate_kbps, "TS bitrate per adapter in kbit/s (1-1000000, default 32000)");
+static int blk_pkts = 1020;
+module_param(blk_pkts, int, 0444);
+MODULE_PARM_DESC(blk_pkts, "TS packets per demux call (1-8192, default 1020 as a PT3 DMA block)");
+static int pid = 0x100;
+module_param(pid, int, 0644);
+MODULE_PARM_DESC(pid, "PID of synthetic packets (default 0x100)");
+static char *ts_file = "";
+module_param(ts_file, charp, 0444);
+MODULE_PARM_DESC(ts_file, "TS file played in a loop instead of synthetic packets, need not be packet aligned");
+
+struct ptx_sim_adap {
+	u8	*buf,
+		cc;
+	bool	run;
+	u32	kbps;
+	ktime_t	t0;
+	u64	sent,
+		seq,
+		drops,
+		lag_max;
+};
+
+static struct platform_device *ptx_sim_pdev;
+
+int ptx_sim_status(struct dvb_frontend *fe, enum fe_status *stat)
+{
+	*stat = FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK;
+	return 0;
+}
+
+enum dvbfe_algo ptx_sim_get_frontend_algo(struct dvb_frontend *fe)
+{
+	return DVBFE_ALGO_HW;
+}
+
+int ptx_sim_tune(struct dvb_frontend *fe, bool retune, u32 mode_flags, u32 *delay, enum fe_status *stat)
+{
+	*delay = HZ;
+	return ptx_sim_status(fe, stat);
+}
+
+static const struct dvb_frontend_ops ptx_sim_ops = {
+	.info = {
+		.name = KBUILD_MODNAME,
+		.caps = FE_CAN_INVERSION_AUTO | FE_CAN_FEC_AUTO | FE_CAN_QAM_AUTO | FE_CAN_MULTISTREAM |
+			FE_CAN_TRANSMISSION_MODE_AUTO | FE_CAN_GUARD_INTERVAL_AUTO | FE_CAN_HIERARCHY_AUTO,
+		.frequency_min_hz	= 1,
+		.frequency_max_hz	= 3224000000,
+	},
+	.get_frontend_algo = ptx_sim_get_frontend_algo,
+	.read_status	= ptx_sim_status,
+	.tune		= ptx_sim_tune,
+};
+
+void ptx_sim_lnb(struct ptx_card *card, bool lnb)
+{
+}
+
+int ptx_sim_dma(struct ptx_adap *adap, bool ON)
+{
+	struct ptx_sim_adap	*p	= adap->priv;
+
+	WRITE_ONCE(p->run, ON);
+	return 0;
+}
+
+void ptx_sim_fill(struct ptx_sim_adap *p, u32 n)
+{
+	u8	*d	= p->buf;
+	u16	id	= clamp(pid, 0, 0x1FFE);
+	u64	ns	= ktime_get_ns();
+
+	for (; n; n--, d += PTX_TS_SIZE) {
+		d[0]	= PTX_TS_SYNC;
+		d[1]	= id >> 8;
+		d[2]	= id & 0xFF;
+		d[3]	= 0x10 | (p->cc++ & 0x0F);	/* payload only */
+		put_unaligned_le64(p->seq++, d + 4);
+		put_unaligned_le64(ns, d + 12);
+	}
+}
+
+u32 ptx_sim_read(struct file *f, loff_t *pos, u8 *buf, u32 sz)	/* loops at EOF, 0 if the file is empty or unreadable */
+{
+	u32	done	= 0;
+	ssize_t	r	= 1;
+
+	while (done < sz && r > 0) {
+		r = kernel_read(f, buf + done, sz - done, pos);
+		if (r > 0)
+			done += r;
+		else if (!r && *pos) {
+			*pos	= 0;
+			r	= 1;
+		}
+	}
+	return done;
+}
+
+int ptx_sim_thread(void *dat)
+{
+	struct ptx_adap		*adap	= dat;
+	struct ptx_sim_adap	*p	= adap->priv;
+	struct file		*f	= NULL;
+	loff_t			pos	= 0;
+
+	if (*ts_file) {
+		f = filp_open(ts_file, O_RDONLY | O_LARGEFILE, 0);
+		if (IS_ERR(f)) {
+			dev_warn(adap->card->dev, "adapter%d: cannot open %s (%ld), sending synthetic TS",
+				adap->dvb.num, ts_file, PTR_ERR(f));
+			f = NULL;
+		}
+	}
+	memset(p->buf, 0xFF, blk_pkts * PTX_TS_SIZE);
+	p->kbps = 0;
+	set_freezable();
+	while (!kthread_should_stop()) {
+		u32	kbps	= clamp(READ_ONCE(bitrate_kbps), 1, 1000000),
+			n;
+		u64	due,
+			lag;
+		ktime_t	t;
+
+		try_to_freeze();
+		ptx_wakeup_stat(adap);
+		if (!READ_ONCE(p->run)) {
+			usleep_range(10000, 20000);
+			continue;
+		}
+		t = ktime_get();
+		if (p->kbps != kbps) {			/* (re)start the schedule */
+			p->kbps	= kbps;
+			p->t0	= t;
+			p->sent	= 0;
+		}
+		due	= div_u64(ktime_to_us(ktime_sub(t, p->t0)) * kbps, PTX_TS_SIZE * 8 * 1000);
+		lag	= due - p->sent;
+		p->lag_max = max(p->lag_max, lag);
+		if (lag > (u64)blk_pkts * PTX_SIM_BLK_MAX) {	/* consumer too slow: drop like an overrun ring */
+			p->drops	+= lag - blk_pkts;
+			p->sent		= due - blk_pkts;
+			lag		= blk_pkts;
+		}
+		if (lag < blk_pkts) {			/* sleep until 1 block is due */
+			u32	us	= div_u64((blk_pkts - lag) * PTX_TS_SIZE * 8 * 1000, kbps);
+
+			us = clamp(us, 100U, 100000U);
+			usleep_range(us, us + (us >> 3));
+			continue;
+		}
+		n = blk_pkts;
+		if (!f)
+			ptx_sim_fill(p, n);
+		else if (ptx_sim_read(f, &pos, p->buf, n * PTX_TS_SIZE) != n * PTX_TS_SIZE) {
+			dev_warn(adap->card->dev, "adapter%d: %s unreadable, sending synthetic TS", adap->dvb.num, ts_file);
+			filp_close(f, NULL);
+			f = NULL;
+			memset(p->buf, 0xFF, blk_pkts * PTX_TS_SIZE);
+			continue;
+		}
+		trace_ptx_block_ready(adap->dvb.num, p->sent, n, lag * PTX_TS_SIZE);
+		if (f)
+			ptx_filter_raw(adap, p->buf, n * PTX_TS_SIZE, 1, p->sent, lag * PTX_TS_SIZE);	/* file may be unaligned */
+		else
+			ptx_filter(adap, p->buf, n, 1, p->sent, lag * PTX_TS_SIZE);
+		p->sent += n;
+	}
+	if (f)
+		filp_close(f, NULL);
+	return 0;
+}
+
+void ptx_sim_remove(struct ptx_card *card)
+{
+	int	i;
+
+	for (i = 0; i < card->adapn; i++) {
+		struct ptx_sim_adap	*p	= card->adap[i].priv;
+
+		kvfree(p->buf);
+	}
+	ptx_unregister_adap(card);
+}
+
+static int __init ptx_sim_init(void)
+{
+	struct ptx_subdev_info	info[PTX_SIM_ADAP_MAX] = {};
+	struct ptx_card		*card;
+	struct ptx_adap		*adap;
+	int	ret,
+		i;
+
+	ptx_sim_pdev = platform_device_register_simple(KBUILD_MODNAME, -1, NULL, 0);
+	if (IS_ERR(ptx_sim_pdev))
+		return PTR_ERR(ptx_sim_pdev);
+	blk_pkts	= clamp(blk_pkts, 1, 8192);
+	card		= ptx_alloc_dev(&ptx_sim_pdev->dev, KBUILD_MODNAME, clamp(adapters, 1, PTX_SIM_ADAP_MAX),
+					0, sizeof(struct ptx_sim_adap), ptx_sim_lnb);
+	if (!card) {
+		platform_device_unregister(ptx_sim_pdev);
+		return -ENOMEM;
+	}
+	for (i = 0, ret = 0; i < card->adapn; i++) {
+		struct ptx_sim_adap	*p	= card->adap[i].priv;
+
+		info[i].delsys[0]	= i & 1 ? SYS_ISDBT : SYS_ISDBS;
+		info[i].ops		= &ptx_sim_ops;
+		p->buf			= kvmalloc(blk_pkts * PTX_TS_SIZE, GFP_KERNEL);
+		if (!p->buf)
+			ret = -ENOMEM;
+	}
+	ret = ret ? ret : ptx_register_adap(card, info, ptx_sim_thread, ptx_sim_dma);
+	if (ret) {
+		ptx_sim_remove(card);
+		platform_device_unregister(ptx_sim_pdev);
+		return ret;
+	}
+	for (i = 0, adap = card->adap; i < card->adapn; i++, adap++) {
+		struct ptx_sim_adap	*p	= adap->priv;
+
+		debugfs_create_u64("drops",	0444, adap->dbgfs, &p->drops);
+		debugfs_create_u64("lag_max",	0644, adap->dbgfs, &p->lag_max);
+	}
+	dev_info(&ptx_sim_pdev->dev, "%d adapters, %d kbit/s, %s", card->adapn, bitrate_kbps, *ts_file ? ts_file : "synthetic TS");
+	return 0;
+}
+
+static void __exit ptx_sim_exit(void)
+{
+	ptx_sim_remove(platform_get_drvdata(ptx_sim_pdev));
+	platform_device_unregister(ptx_sim_pdev);
+}
+
+module_init(ptx_sim_init);
+module_exit(ptx_sim_exit);
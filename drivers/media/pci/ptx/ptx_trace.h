@@ -0,0 +1,99 @@
+/*
+	Tracepoints for the PTX DMA -> demux path
+
+	ptx_common.o is linked into every bridge module, so each bridge instantiates
+	the events under its own system by defining PTX_TRACE_SYSTEM & CREATE_TRACE_POINTS
+	before including this file, e.g. pt3:ptx_block_ready, pxq3pe:ptx_block_ready.
+
+	Copyright (C) Budi Rachmanto, AreMa Inc. <info@are.ma>
+*/
+
+#undef TRACE_SYSTEM
+#ifdef PTX_TRACE_SYSTEM
+#define TRACE_SYSTEM PTX_TRACE_SYSTEM
+#else
+#define TRACE_SYSTEM ptx
+#endif
+
+#if !defined(PTX_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define PTX_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(ptx_dma,
+	TP_PROTO(int adap, bool ON, int err),
+	TP_ARGS(adap, ON, err),
+	TP_STRUCT__entry(
+		__field(int,	adap)
+		__field(bool,	ON)
+		__field(int,	err)
+	),
+	TP_fast_assign(
+		__entry->adap	= adap;
+		__entry->ON	= ON;
+		__entry->err	= err;
+	),
+	TP_printk("adapter%d %s err=%d", __entry->adap, __entry->ON ? "start" : "stop", __entry->err)
+);
+
+DECLARE_EVENT_CLASS(ptx_block,	/* idx: ring index, pkts: TS packets, fill: ring fill in bytes */
+	TP_PROTO(int adap, u32 idx, u32 pkts, u32 fill),
+	TP_ARGS(adap, idx, pkts, fill),
+	TP_STRUCT__entry(
+		__field(int,	adap)
+		__field(u32,	idx)
+		__field(u32,	pkts)
+		__field(u32,	fill)
+	),
+	TP_fast_assign(
+		__entry->adap	= adap;
+		__entry->idx	= idx;
+		__entry->pkts	= pkts;
+		__entry->fill	= fill;
+	),
+	TP_printk("adapter%d idx=%u pkts=%u fill=%u", __entry->adap, __entry->idx, __entry->pkts, __entry->fill)
+);
+
+DEFINE_EVENT(ptx_block, ptx_block_ready,
+	TP_PROTO(int adap, u32 idx, u32 pkts, u32 fill),
+	TP_ARGS(adap, idx, pkts, fill)
+);
+
+DEFINE_EVENT(ptx_block, ptx_block_consumed,
+	TP_PROTO(int adap, u32 idx, u32 pkts, u32 fill),
+	TP_ARGS(adap, idx, pkts, fill)
+);
+
+TRACE_EVENT(ptx_irq_entry,
+	TP_PROTO(u32 stat),
+	TP_ARGS(stat),
+	TP_STRUCT__entry(
+		__field(u32,	stat)
+	),
+	TP_fast_assign(
+		__entry->stat	= stat;
+	),
+	TP_printk("stat=0x%x", __entry->stat)
+);
+
+TRACE_EVENT(ptx_irq_exit,
+	TP_PROTO(u32 stat, int ret),
+	TP_ARGS(stat, ret),
+	TP_STRUCT__entry(
+		__field(u32,	stat)
+		__field(int,	ret)
+	),
+	TP_fast_assign(
+		__entry->stat	= stat;
+		__entry->ret	= ret;
+	),
+	TP_printk("stat=0x%x ret=%d", __entry->stat, __entry->ret)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ptx_trace
+#include <trace/define_trace.h>
@@ -11,15 +11,21 @@
 */
 
 #include <linux/interrupt.h>
+#include <linux/seq_file.h>
 #include <linux/vmalloc.h>
+#include <asm/unaligned.h>
 #include "ptx_common.h"
 #include "tc90522.h"
 #include "tda2014x.h"
 #include "nm131.h"
+#define PTX_TRACE_SYSTEM pxq3pe
+#define CREATE_TRACE_POINTS
+#include "ptx_trace.h"
 
 MODULE_AUTHOR(PTX_AUTH);
 MODULE_DESCRIPTION("PLEX PX-Q3PE Driver");
 MODULE_LICENSE("GPL");
+MODULE_SOFTDEP("pre: " TC90522_MODNAME " " NM131_MODNAME " " TDA2014X_MODNAME);	/* async probe cannot request_module() */
 
 //static char	auth[]	= PTX_AUTH;
 //module_param(auth, charp, 0);
@@ -29,6 +35,10 @@ static int	ni,
 		xor[4]	= {0x2F, 0x46, 0x56, 0xE3};
 module_param_array(idx, int, &ni, 0);
 module_param_array(xor, int, &nx, 0);
+static int	nk,
+		sbuf_kb[8]	= {9400, 9400, 9400, 9400, 9400, 9400, 9400, 9400};
+module_param_array(sbuf_kb, int, &nk, 0444);
+MODULE_PARM_DESC(sbuf_kb, "Stream ring size in KiB, per adapter (64-262144, default 9400)");
 
 static struct pci_device_id pxq3pe_id_table[] = {
 	{0x188B, 0x5220, 0x0B06, 0x0002, 0, 0, 0},
@@ -67,6 +77,7 @@ enum ePXQ3PE {
 	PXQ3PE_DMA_CTL		= 0xACC,
 
 	PXQ3PE_MAX_LOOP		= 1000,
+	PXQ3PE_HIST_CNT		= 16,	/* log2 buckets of ~1 us	*/
 };
 
 struct pxq3pe_card {
@@ -78,16 +89,27 @@ struct pxq3pe_card {
 		bool		ON[2];
 	} dma;
 	bool	irq_enabled;
+	u64	xor64;						/* descrambling pattern xor[idx[0..7]]	*/
+	unsigned long		pending;			/* DMA sub-buffers (port * 2 + ch) awaiting fan-out */
+	u16	pkt_cnt[4][4],					/* [sub-buffer][adapter in port]	*/
+		pkt_off[4][4][PKT_NUM];				/* packet offsets in sub-buffer		*/
+	u64	irq_t0[4],					/* top half entry per sub-buffer	*/
+		irq_cnt,
+		irq_ns,
+		irq_max_ns,
+		hist_top[PXQ3PE_HIST_CNT],			/* top half run time			*/
+		hist_thread[PXQ3PE_HIST_CNT];			/* top half entry to fan-out done	*/
 };
 
 struct pxq3pe_adap {
-	u8	tBuf[PKT_BUFSZ],
-		*sBuf;
-	u32	tBufIdx,
-		sBufSize,
-		sBufStart,
-		sBufStop,
-		sBufByteCnt;
+	u8	*sBuf;
+	u32	sBufSize,
+		sBufStart,	/* consumer index, written by pxq3pe_thread, or by pxq3pe_dma while it is not running	*/
+		sBufStop;	/* producer index, written by pxq3pe_irq_thread only	*/
+	u64	overflows,
+		drops;
+	u32	fill_hwm;	/* ring fill high-water mark, bytes	*/
+	wait_queue_head_t	wait;
 };
 
 bool pxq3pe_i2c_clean(void __iomem *bar)
@@ -234,7 +256,7 @@ int pxq3pe_i2c_xfr(struct i2c_adapter *i2c, struct i2c_msg *msg, int sz)
 
 	if (!i2c || !card || !msg)
 		return -EINVAL;
-	for (i = 0; i < sz && ret; i++, msg++) {
+	for (i = 0; i < sz && ret; i++, msg++) {	/* card->lock per message: other demods' transfers interleave */
 		u8	regadr	= msg->addr >> 8,
 			slvadr	= (msg->addr & 0xFF) == PXQ3PE_I2C_ADR_GPIO ? PXQ3PE_I2C_ADR_GPIO
 				: (msg->addr & 0x80) | ((msg->addr >> 1) & 7),
@@ -242,18 +264,21 @@ int pxq3pe_i2c_xfr(struct i2c_adapter *i2c, struct i2c_msg *msg, int sz)
 				: slvadr & 0x80			? PXQ3PE_MOD_STAT
 				: PXQ3PE_MOD_TUNER;
 
-		mutex_lock(&card->lock);
 		if (msg->flags & I2C_M_RD) {
-			u8 *buf	= kzalloc(sz, GFP_KERNEL);
+			u8 *buf	= kzalloc(round_up(msg->len, 4), GFP_KERNEL);	/* FIFO is read in u32 */
 
 			if (!buf)
 				return -ENOMEM;
+			mutex_lock(&card->lock);
 			ret	= pxq3pe_r(card, slvadr, regadr, buf, msg->len, mode);
+			mutex_unlock(&card->lock);
 			memcpy(msg->buf, buf, msg->len);
 			kfree(buf);
-		} else
+		} else {
+			mutex_lock(&card->lock);
 			ret = pxq3pe_w(card, slvadr, regadr, msg->buf, msg->len, mode);
-		mutex_unlock(&card->lock);
+			mutex_unlock(&card->lock);
+		}
 	}
 	return i;
 }
@@ -307,101 +332,208 @@ void pxq3pe_power(struct ptx_card *card, bool ON)
 	}
 }
 
-irqreturn_t pxq3pe_irq(int irq, void *ctx)
+void pxq3pe_hist(u64 *hist, u64 ns)
+{
+	hist[min_t(int, fls64(ns >> 10), PXQ3PE_HIST_CNT - 1)]++;
+}
+
+irqreturn_t pxq3pe_irq(int irq, void *ctx)	/* ack & hand the finished sub-buffers to pxq3pe_irq_thread */
 {
 	struct ptx_card		*card	= ctx;
 	struct pxq3pe_card	*c	= card->priv;
 	void __iomem		*bar	= c->bar;
-	u32	dmamgmt,
-		i,
-		irqstat = readl(bar + PXQ3PE_IRQ_STAT);
-	bool	ch	= irqstat & 0b0101 ? 0 : 1,
-		port	= irqstat & 0b0011 ? 0 : 1;
-	u8	*tbuf	= c->dma.dat + PKT_BUFSZ * (port * 2 + ch);
-
-	void pxq3pe_dma_put_stream(struct pxq3pe_adap *p)
-	{
-		u8	*src	= p->tBuf;
-		u32	len	= p->tBufIdx,
-			savesz	= len <= p->sBufSize - p->sBufStop ? len : p->sBufSize - p->sBufStop,
-			remain	= len - savesz;
-
-		memcpy(&p->sBuf[p->sBufStop], src, savesz);
-		if (remain)
-			memcpy(p->sBuf, &src[savesz], remain);
-		p->sBufStop = (p->sBufStop + len) % p->sBufSize;
-		if (p->sBufByteCnt == p->sBufSize)
-			p->sBufStart = p->sBufStop;
-		else {
-			if (p->sBufSize >= p->sBufByteCnt + len)
-				p->sBufByteCnt += len;
-			else {
-				p->sBufStart = p->sBufStop;
-				p->sBufByteCnt = p->sBufSize;
-			}
-		}
+	u64		t0	= ktime_get_ns();
+	u32		irqstat = readl(bar + PXQ3PE_IRQ_STAT);
+	unsigned long	done	= irqstat & 0b1111;	/* bit port * 2 + ch, several may be set at once */
+	int		sub;
+
+	trace_ptx_irq_entry(irqstat);
+	if (!done) {
+		trace_ptx_irq_exit(irqstat, IRQ_NONE);
+		return IRQ_NONE;
 	}
-
-	if (!(irqstat & 0b1111))
-		return IRQ_HANDLED;
 	writel(irqstat, bar + PXQ3PE_IRQ_CLEAR);
-	dmamgmt = readl(bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
-	if ((readl(bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_OFFSET_CH * ch + PXQ3PE_DMA_XFR_STAT) & 0x3FFFFF) == PKT_BUFSZ)
-		for (i = 0; i < PKT_BUFSZ; i += PTX_TS_SIZE) {
-			u8 idx = !port * 4 + (tbuf[i] == 0xC7 ? 0 : tbuf[i] == 0x47 ?
-					1 : tbuf[i] == 0x07 ? 2 : tbuf[i] == 0x87 ? 3 : card->adapn);
-			struct ptx_adap		*adap	= &card->adap[idx];
+	for_each_set_bit(sub, &done, 4) {
+		c->irq_t0[sub] = t0;
+		set_bit(sub, &c->pending);		/* channel stays halted until the thread re-arms it */
+	}
+	t0 = ktime_get_ns() - t0;
+	c->irq_cnt++;
+	c->irq_ns += t0;
+	if (c->irq_max_ns < t0)
+		c->irq_max_ns = t0;
+	pxq3pe_hist(c->hist_top, t0);
+	trace_ptx_irq_exit(irqstat, IRQ_WAKE_THREAD);
+	return IRQ_WAKE_THREAD;
+}
+
+irqreturn_t pxq3pe_irq_thread(int irq, void *ctx)
+{
+	struct ptx_card		*card	= ctx;
+	struct pxq3pe_card	*c	= card->priv;
+	u8			sub,
+				k;
+
+	for (sub = 0; sub < 4; sub++) {
+		bool		port	= sub >> 1,
+				ch	= sub & 1;
+		u8		*tbuf	= c->dma.dat + PKT_BUFSZ * sub;
+		void __iomem	*mgmt	= c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT;
+		u32		i;
+
+		if (!test_and_clear_bit(sub, &c->pending))
+			continue;
+		memset(c->pkt_cnt[sub], 0, sizeof(c->pkt_cnt[sub]));
+		if ((readl(c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_OFFSET_CH * ch + PXQ3PE_DMA_XFR_STAT) & 0x3FFFFF) == PKT_BUFSZ)
+			for (i = 0; i < PKT_BUFSZ; i += PTX_TS_SIZE) {
+				k = tbuf[i] == 0xC7 ? 0 : tbuf[i] == 0x47 ? 1 : tbuf[i] == 0x07 ? 2 : tbuf[i] == 0x87 ? 3 : 4;
+				if (k < 4)
+					c->pkt_off[sub][k][c->pkt_cnt[sub][k]++] = i;
+			}
+		for (k = 0; k < 4 && !port * 4 + k < card->adapn; k++) {
+			struct ptx_adap		*adap	= &card->adap[!port * 4 + k];
 			struct pxq3pe_adap	*p	= adap->priv;
+			u32			stop	= p->sBufStop,
+						room	= (smp_load_acquire(&p->sBufStart) + p->sBufSize - stop - PTX_TS_SIZE) % p->sBufSize,
+						j;
 
-			if (idx < card->adapn && adap->ON) {
-				tbuf[i] = PTX_TS_SYNC;
-				memcpy(&p->tBuf[p->tBufIdx], &tbuf[i], PTX_TS_SIZE);
-				p->tBufIdx += PTX_TS_SIZE;
-				if (p->tBufIdx >= PKT_BUFSZ) {
-					pxq3pe_dma_put_stream(p);
-					p->tBufIdx = 0;
-				}
+			if (!adap->ON || !READ_ONCE(adap->feeds) || !c->pkt_cnt[sub][k])
+				continue;
+			for (j = 0; j < c->pkt_cnt[sub][k]; j++) {	/* the only copy: DMA -> sBuf */
+				u8 *dst = &p->sBuf[stop];
+
+				if (room < PTX_TS_SIZE)			/* full: drop, never touch the consumer index */
+					break;
+				memcpy(dst, &tbuf[c->pkt_off[sub][k][j]], PTX_TS_SIZE);
+				*dst	= PTX_TS_SYNC;
+				stop	= (stop + PTX_TS_SIZE) % p->sBufSize;
+				room	-= PTX_TS_SIZE;
+			}
+			if (j < c->pkt_cnt[sub][k]) {
+				p->overflows++;
+				p->drops += c->pkt_cnt[sub][k] - j;
 			}
+			if (p->fill_hwm < p->sBufSize - PTX_TS_SIZE - room)
+				p->fill_hwm = p->sBufSize - PTX_TS_SIZE - room;
+			smp_store_release(&p->sBufStop, stop);		/* publish the packets before the index */
+			trace_ptx_block_ready(adap->dvb.num, stop, j, p->sBufSize - PTX_TS_SIZE - room);
+			wake_up_interruptible(&p->wait);
 		}
-	if (c->dma.ON[port])
-		writel(dmamgmt | (2 << (ch * 16)), bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
+		if (c->dma.ON[port])
+			writel(readl(mgmt) | (2 << (ch * 16)), mgmt);
+		pxq3pe_hist(c->hist_thread, ktime_get_ns() - c->irq_t0[sub]);
+	}
 	return IRQ_HANDLED;
 }
 
+int pxq3pe_irq_hist_show(struct seq_file *m, void *v)
+{
+	struct pxq3pe_card	*c	= ((struct ptx_card *)m->private)->priv;
+	int			i;
+
+	seq_puts(m, "      <us        top     thread\n");
+	for (i = 0; i < PXQ3PE_HIST_CNT - 1; i++)
+		seq_printf(m, "%9lu %10llu %10llu\n", 1ul << i, c->hist_top[i], c->hist_thread[i]);
+	seq_printf(m, "      inf %10llu %10llu\n", c->hist_top[i], c->hist_thread[i]);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(pxq3pe_irq_hist);
+
 int pxq3pe_thread(void *dat)
 {
 	struct ptx_adap		*adap	= dat;
 	struct pxq3pe_adap	*p	= adap->priv;
+	struct pxq3pe_card	*c	= adap->card->priv;
 
 	set_freezable();
 	while (!kthread_should_stop()) {
-		u8	*rbuf	= &p->sBuf[p->sBufStart];
-		int	i	= 0,
-			j	= 0,
+		u32	start,
+			stop;
+		u8	*rbuf;
+		int	i,
 			k,
-			sz	= p->sBufSize - p->sBufStart;
-
-		try_to_freeze();
-		if (!p->sBufByteCnt) {
-			msleep_interruptible(0);
+			sz;
+
+		try_to_freeze();		/* before the indices are read: resume may move sBufStart */
+		start	= p->sBufStart;
+		stop	= smp_load_acquire(&p->sBufStop);	/* pairs with the producer's release */
+		rbuf	= &p->sBuf[start];
+		sz	= (stop < start ? p->sBufSize : stop) - start;
+		ptx_wakeup_stat(adap);
+		if (!sz) {
+			wait_event_freezable(p->wait, smp_load_acquire(&p->sBufStop) != p->sBufStart || kthread_should_stop());
 			continue;
 		}
-		if (sz > p->sBufByteCnt)
-			sz = p->sBufByteCnt;
-		while (j < sz / PTX_TS_SIZE) {
-			j++;
-			i += 4;
-			while (i < j * PTX_TS_SIZE)
-				for (k = 0; k < 8; k++, i++)
-					rbuf[i] ^= xor[idx[k]];
-		}
-		dvb_dmx_swfilter(&adap->demux, rbuf, sz);
-		p->sBufStart	= (p->sBufStart + sz) % p->sBufSize;
-		p->sBufByteCnt -= sz;
+		for (i = 0; i < sz; i += PTX_TS_SIZE)		/* 184B payload = 23 x 8B, header left as is */
+			for (k = 4; k < PTX_TS_SIZE; k += 8)
+				put_unaligned(get_unaligned((u64 *)(rbuf + i + k)) ^ c->xor64, (u64 *)(rbuf + i + k));
+		ptx_filter(adap, rbuf, sz / PTX_TS_SIZE, 1, start, (stop + p->sBufSize - start) % p->sBufSize);	/* sync bytes restored by the producer */
+		smp_store_release(&p->sBufStart, (start + sz) % p->sBufSize);	/* hand the space back to the producer */
 	}
 	return 0;
 }
 
+ssize_t sbuf_bytes_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pxq3pe_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%u\n", p->sBufSize);
+}
+
+ssize_t fill_bytes_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pxq3pe_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%u\n", (READ_ONCE(p->sBufStop) + p->sBufSize - READ_ONCE(p->sBufStart)) % p->sBufSize);
+}
+
+ssize_t fill_hwm_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pxq3pe_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%u\n", p->fill_hwm);
+}
+
+ssize_t fill_hwm_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)	/* any write resets */
+{
+	struct pxq3pe_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	p->fill_hwm = 0;
+	return count;
+}
+
+ssize_t drops_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct pxq3pe_adap	*p	= ptx_kobj2adap(kobj)->priv;
+
+	return sprintf(buf, "%llu\n", p->drops);
+}
+
+static struct kobj_attribute	pxq3pe_attr_sbuf_bytes	= __ATTR_RO(sbuf_bytes),
+				pxq3pe_attr_fill_bytes	= __ATTR_RO(fill_bytes),
+				pxq3pe_attr_fill_hwm	= __ATTR_RW(fill_hwm),
+				pxq3pe_attr_drops	= __ATTR_RO(drops);
+static struct attribute *pxq3pe_attrs[] = {
+	&pxq3pe_attr_sbuf_bytes.attr,
+	&pxq3pe_attr_fill_bytes.attr,
+	&pxq3pe_attr_fill_hwm.attr,
+	&pxq3pe_attr_drops.attr,
+	NULL,
+};
+static const struct attribute_group pxq3pe_attr_group = {
+	.attrs	= pxq3pe_attrs,
+};
+
+void pxq3pe_dma_stop(struct pxq3pe_card *c, bool port)
+{
+	u8	i	= readb(c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
+
+	if ((i & 0b1100) == 4)
+		writeb(i & 0xFD, c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
+	writeb(0b0011 << (port * 2), c->bar + PXQ3PE_IRQ_DISABLE);
+	c->dma.ON[port] = false;
+}
+
 int pxq3pe_dma(struct ptx_adap *adap, bool ON)
 {
 	struct ptx_card		*card	= adap->card;
@@ -417,18 +549,12 @@ int pxq3pe_dma(struct ptx_adap *adap, bool ON)
 		for (i = 0; i < card->adapn; i++)
 			if (!c->dma.ON[port] || (idx != i && (i & 4) == (idx & 4) && c->dma.ON[port]))
 				return 0;
-
-		i = readb(c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
-		if ((i & 0b1100) == 4)
-			writeb(i & 0xFD, c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
-		writeb(0b0011 << (port * 2), c->bar + PXQ3PE_IRQ_DISABLE);
-		c->dma.ON[port] = false;
+		pxq3pe_dma_stop(c, port);
 		return 0;
 	}
 
-	p->sBufByteCnt	= 0;
-	p->sBufStop	= 0;
-	p->sBufStart	= 0;
+	synchronize_irq(card->pdev->irq);				/* a fan-out begun before the feeds stopped is done */
+	smp_store_release(&p->sBufStart, READ_ONCE(p->sBufStop));	/* drop stale packets, sBufStop stays the producer's */
 	if (c->dma.ON[port])
 		return 0;
 
@@ -445,9 +571,10 @@ int pxq3pe_dma(struct ptx_adap *adap, bool ON)
 	/* cfg_dma */
 	for (i = 0; i < 2; i++) {
 		val		= readl(c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
-		writel(c->dma.adr + PKT_BUFSZ * (port * 2 + i),
+		writel(lower_32_bits(c->dma.adr + PKT_BUFSZ * (port * 2 + i)),
 					c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_OFFSET_CH * i + PXQ3PE_DMA_ADR_LO);
-		writel(0,		c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_OFFSET_CH * i + PXQ3PE_DMA_ADR_HI);
+		writel(upper_32_bits(c->dma.adr + PKT_BUFSZ * (port * 2 + i)),
+					c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_OFFSET_CH * i + PXQ3PE_DMA_ADR_HI);
 		writel(0x11C0E520,	c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_OFFSET_CH * i + PXQ3PE_DMA_CTL);
 		writel(val | 3 << (i * 16),
 					c->bar + PXQ3PE_DMA_OFFSET_PORT * port + PXQ3PE_DMA_MGMT);
@@ -461,6 +588,37 @@ void pxq3pe_lnb(struct ptx_card *card, bool lnb)
 	pxq3pe_w_gpio2(card, lnb ? 0x20 : 0, 0x20);
 }
 
+bool pxq3pe_hw_init(struct ptx_card *card)	/* at probe & resume, DMA buffers are not touched */
+{
+	struct pxq3pe_card	*c	= card->priv;
+	u8	regctl	= 0xA0,
+		i;
+
+	writeb(readb(c->bar + 0x880) & 0xC0, c->bar + 0x880);
+	writel(0x3200C8, c->bar + 0x904);
+	writel(0x90,	 c->bar + 0x900);
+	writel(0x10000,	 c->bar + 0x880);
+	writel(0x0080,	 c->bar + 0x0A00	/*PXQ3PE_DMA_TSMODE*/);				/* port 0 */
+	writel(0x0080,	 c->bar + 0x0B40	/*PXQ3PE_DMA_TSMODE + PXQ3PE_DMA_OFFSET_PORT*/);/* port 1 */
+	writel(0x0000,	 c->bar + 0x0888);
+	writel(0x00CF,	 c->bar + 0x0894);
+	writel(0x8000,	 c->bar + 0x088C);
+	writel(0x1004,	 c->bar + 0x0890);
+	writel(0x0090,	 c->bar + 0x0900);
+	writel(0x3200C8, c->bar + 0x0904);
+	pxq3pe_w_gpio0(card, 8, 0xFF);
+	pxq3pe_w_gpio1(card, 0, 2);
+	pxq3pe_w_gpio1(card, 1, 1);
+	pxq3pe_w_gpio0(card, 1, 1);
+	pxq3pe_w_gpio0(card, 0, 1);
+	pxq3pe_w_gpio0(card, 1, 1);
+
+	for (i = 0; i < 16; i++)
+		if (!pxq3pe_w(card, PXQ3PE_I2C_ADR_GPIO, 0x10 + i, PTX_AUTH + i, 1, PXQ3PE_MOD_GPIO))
+			return false;
+	return pxq3pe_w(card, PXQ3PE_I2C_ADR_GPIO, 5, &regctl, 1, PXQ3PE_MOD_GPIO);
+}
+
 void pxq3pe_remove(struct pci_dev *pdev)
 {
 	struct ptx_card		*card	= pci_get_drvdata(pdev);
@@ -480,16 +638,16 @@ void pxq3pe_remove(struct pci_dev *pdev)
 	pxq3pe_power(card, false);
 
 	/* dma_hw_unmap */
-	if (c->dma.dat)
-		dma_free_attrs(&pdev->dev, c->dma.sz, c->dma.dat, c->dma.adr, 0);
 	if (c->irq_enabled)
 		free_irq(pdev->irq, card);
+	if (c->dma.dat)
+		dma_free_attrs(&pdev->dev, c->dma.sz, c->dma.dat, c->dma.adr, 0);
 
 	for (i = 0; i < card->adapn; i++) {
 		struct ptx_adap		*adap	= &card->adap[i];
 		struct pxq3pe_adap	*p	= adap->priv;
 
-		vfree(p->sBuf);
+		kvfree(p->sBuf);
 	}
 	if (c->bar)
 		pci_iounmap(pdev, c->bar);
@@ -513,11 +671,10 @@ static int pxq3pe_probe(struct pci_dev *pdev, const struct pci_device_id *pci_id
 		{0x1C, TC90522_MODNAME, 0x1D, NM131_MODNAME,	{SYS_ISDBT}},
 		{0x1E, TC90522_MODNAME, 0x1F, TDA2014X_MODNAME,	{SYS_ISDBS}},
 	};
-	struct ptx_card		*card	= ptx_alloc(pdev, KBUILD_MODNAME, ARRAY_SIZE(pxq3pe_subdev_info),
+	struct ptx_card		*card	= ptx_alloc(pdev, KBUILD_MODNAME, ARRAY_SIZE(pxq3pe_subdev_info), 64,
 						sizeof(struct pxq3pe_card), sizeof(struct pxq3pe_adap), pxq3pe_lnb);
 	struct pxq3pe_card	*c	= card->priv;
-	u8	regctl	= 0xA0,
-		i;
+	u8	i;
 	u16	cfg;
 	int	err	= !card || pci_read_config_word(pdev, PCI_COMMAND, &cfg);
 
@@ -539,14 +696,18 @@ static int pxq3pe_probe(struct pci_dev *pdev, const struct pci_device_id *pci_id
 		struct ptx_adap		*adap	= &card->adap[i];
 		struct pxq3pe_adap	*p	= adap->priv;
 
-		p->sBufSize	= PTX_TS_SIZE * 100 << 9;
-		p->sBuf		= vzalloc(p->sBufSize);
+		p->sBufSize	= rounddown(clamp(sbuf_kb[i], 64, 262144) << 10, PTX_TS_SIZE);
+		p->sBuf		= kvzalloc_node(p->sBufSize, GFP_KERNEL, dev_to_node(&pdev->dev));	/* high-order pages if cheap, vmalloc otherwise */
 		if (!p->sBuf)
 			return ptx_abort(pdev, pxq3pe_remove, -ENOMEM, "No memory for stream buffer");
+		init_waitqueue_head(&p->wait);
 	}
 
+	for (i = 0; i < 8; i++)
+		((u8 *)&c->xor64)[i] = xor[idx[i]];
+
 	/* IRQ & DMA map */
-	if (request_irq(pdev->irq, pxq3pe_irq, IRQF_SHARED, KBUILD_MODNAME, card))
+	if (request_threaded_irq(pdev->irq, pxq3pe_irq, pxq3pe_irq_thread, IRQF_SHARED, KBUILD_MODNAME, card))
 		return ptx_abort(pdev, pxq3pe_remove, -EIO, "IRQ failed");
 	c->irq_enabled	= true;
 	c->dma.sz	= PKT_BUFSZ * 4;
@@ -554,41 +715,64 @@ static int pxq3pe_probe(struct pci_dev *pdev, const struct pci_device_id *pci_id
 	if (!c->dma.dat)
 		return ptx_abort(pdev, pxq3pe_remove, -EIO, "DMA mapping failed");
 
-	/* hw_init */
-	writeb(readb(c->bar + 0x880) & 0xC0, c->bar + 0x880);
-	writel(0x3200C8, c->bar + 0x904);
-	writel(0x90,	 c->bar + 0x900);
-	writel(0x10000,	 c->bar + 0x880);
-	writel(0x0080,	 c->bar + 0x0A00	/*PXQ3PE_DMA_TSMODE*/);				/* port 0 */
-	writel(0x0080,	 c->bar + 0x0B40	/*PXQ3PE_DMA_TSMODE + PXQ3PE_DMA_OFFSET_PORT*/);/* port 1 */
-	writel(0x0000,	 c->bar + 0x0888);
-	writel(0x00CF,	 c->bar + 0x0894);
-	writel(0x8000,	 c->bar + 0x088C);
-	writel(0x1004,	 c->bar + 0x0890);
-	writel(0x0090,	 c->bar + 0x0900);
-	writel(0x3200C8, c->bar + 0x0904);
-	pxq3pe_w_gpio0(card, 8, 0xFF);
-	pxq3pe_w_gpio1(card, 0, 2);
-	pxq3pe_w_gpio1(card, 1, 1);
-	pxq3pe_w_gpio0(card, 1, 1);
-	pxq3pe_w_gpio0(card, 0, 1);
-	pxq3pe_w_gpio0(card, 1, 1);
-
-	for (i = 0; i < 16; i++)
-		if (!pxq3pe_w(card, PXQ3PE_I2C_ADR_GPIO, 0x10 + i, PTX_AUTH + i, 1, PXQ3PE_MOD_GPIO))
-			break;
-	if (i < 16 || !pxq3pe_w(card, PXQ3PE_I2C_ADR_GPIO, 5, &regctl, 1, PXQ3PE_MOD_GPIO))
-		return ptx_abort(pdev, pxq3pe_remove, -EIO, "hw_init failed i=%d", i);
+	if (!pxq3pe_hw_init(card))
+		return ptx_abort(pdev, pxq3pe_remove, -EIO, "hw_init failed");
 	pxq3pe_power(card, true);
 
 	err = ptx_register_adap(card, pxq3pe_subdev_info, pxq3pe_thread, pxq3pe_dma);
-	return err ? ptx_abort(pdev, pxq3pe_remove, err, "Unable to register DVB adapter & frontend (err=%d)", err) : 0;
+	if (err)
+		return ptx_abort(pdev, pxq3pe_remove, err, "Unable to register DVB adapter & frontend (err=%d)", err);
+	debugfs_create_u64("irq_cnt",		0444, card->dbgfs, &c->irq_cnt);
+	debugfs_create_u64("irq_ns",		0444, card->dbgfs, &c->irq_ns);
+	debugfs_create_u64("irq_max_ns",	0444, card->dbgfs, &c->irq_max_ns);
+	debugfs_create_file("irq_hist",		0444, card->dbgfs, card, &pxq3pe_irq_hist_fops);
+	for (i = 0; i < card->adapn; i++) {
+		struct ptx_adap		*adap	= &card->adap[i];
+		struct pxq3pe_adap	*p	= adap->priv;
+
+		debugfs_create_u64("overflows",	0444, adap->dbgfs, &p->overflows);
+		debugfs_create_u64("drops",	0444, adap->dbgfs, &p->drops);
+		if (sysfs_create_group(adap->kobj, &pxq3pe_attr_group))
+			return ptx_abort(pdev, pxq3pe_remove, -ENOMEM, "Failed sysfs_create_group");
+	}
+	return 0;
+}
+
+int pxq3pe_suspend(struct device *dev)
+{
+	struct ptx_card		*card	= dev_get_drvdata(dev);
+	struct pxq3pe_card	*c	= card->priv;
+	u8	regctl	= 0;
+
+	ptx_suspend(card);
+	pxq3pe_dma_stop(c, 0);
+	pxq3pe_dma_stop(c, 1);
+	synchronize_irq(to_pci_dev(dev)->irq);	/* no fan-out left running into the stream buffers */
+	pxq3pe_w(card, PXQ3PE_I2C_ADR_GPIO, 0x80, &regctl, 1, PXQ3PE_MOD_GPIO);
+	pxq3pe_power(card, false);
+	return 0;
 }
 
+int pxq3pe_resume(struct device *dev)	/* ASIC lost its state, the DMA buffer & stream buffers are still in place */
+{
+	struct ptx_card	*card	= dev_get_drvdata(dev);
+
+	if (!pxq3pe_hw_init(card)) {
+		dev_err(dev, "resume failed, reload the driver");
+		return -EIO;
+	}
+	pxq3pe_power(card, true);
+	return ptx_resume(card);
+}
+
+static SIMPLE_DEV_PM_OPS(pxq3pe_pm_ops, pxq3pe_suspend, pxq3pe_resume);
+
 static struct pci_driver pxq3pe_driver = {
 	.name		= KBUILD_MODNAME,
 	.id_table	= pxq3pe_id_table,
 	.probe		= pxq3pe_probe,
 	.remove		= pxq3pe_remove,
+	.driver.probe_type	= PROBE_PREFER_ASYNCHRONOUS,
+	.driver.pm	= &pxq3pe_pm_ops,
 };
 module_pci_driver(pxq3pe_driver);
\ No newline at end of file
@@ -10,38 +10,20 @@
 */
 
 #include <media/dvb_frontend.h>
+#include "tc90522.h"
+#include "ptx_shadow.h"
 #include "mxl301rf.h"
 
-int mxl301rf_w(struct dvb_frontend *fe, u8 slvadr, const u8 *dat, int len)
-{
-	struct i2c_client	*d	= fe->demodulator_priv;
-	u8			*buf	= kzalloc(len + 1, GFP_KERNEL);
-	int			ret;
-	struct i2c_msg		msg[] = {
-		{.addr = d->addr,	.flags = 0,	.buf = buf,	.len = len + 1,},
-	};
-
-	if (!buf)
-		return -ENOMEM;
-	buf[0]	= slvadr;
-	memcpy(buf + 1, dat, len);
-	ret	= i2c_transfer(d->adapter, msg, 1);
-	kfree(buf);
-	return	ret == 1 ? 0 : -EIO;
-}
+struct mxl301rf {
+	struct ptx_shadow	hw;
+};
 
 int mxl301rf_w_tuner(struct dvb_frontend *fe, const u8 *dat, int len)
 {
-	u8	*buf	= kzalloc(len + 1, GFP_KERNEL);
-	int	ret;
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
 
-	if (!buf)
-		return -ENOMEM;
-	buf[0]	= ((struct i2c_client *)fe->tuner_priv)->addr << 1;
-	memcpy(buf + 1, dat, len);
-	ret	= mxl301rf_w(fe, 0xFE, buf, len + 1);
-	kfree(buf);
-	return ret;
+	tc90522_batch_w_tuner(&b, fe->tuner_priv, dat, len);
+	return tc90522_batch_run(&b);
 }
 
 u8 mxl301rf_r(struct dvb_frontend *fe, u8 regadr)
@@ -58,33 +40,62 @@ u8 mxl301rf_r(struct dvb_frontend *fe, u8 regadr)
 	return t->addr && (i2c_transfer(d->adapter, msg, 2) == 2) ? rbuf[2] : 0;
 }
 
+void mxl301rf_b_tuner(struct dvb_frontend *fe, struct tc90522_batch *b, const u8 *dat, u8 len)	/* {reg, val} pairs, unchanged ones dropped */
+{
+	struct mxl301rf	*m	= i2c_get_clientdata(fe->tuner_priv);
+	u8		buf[TC90522_BATCH_LEN - 2],
+			n	= 0;
+
+	for (; len >= 2 && n < sizeof(buf); len -= 2, dat += 2)
+		if (ptx_shadow_dirty(&m->hw, dat[0], dat[1])) {
+			buf[n++] = dat[0];
+			buf[n++] = dat[1];
+		}
+	if (n)
+		tc90522_batch_w_tuner(b, fe->tuner_priv, buf, n);
+}
+
+int mxl301rf_run(struct dvb_frontend *fe, struct tc90522_batch *b)
+{
+	struct mxl301rf	*m	= i2c_get_clientdata(fe->tuner_priv);
+
+	if (tc90522_batch_run(b))
+		ptx_shadow_reset(&m->hw);
+	return b->err;
+}
+
 enum mxl301rf_agc {
 	MXL301RF_AGC_AUTO,
 	MXL301RF_AGC_MANUAL,
 };
 
-int mxl301rf_set_agc(struct dvb_frontend *fe, enum mxl301rf_agc agc)
+void mxl301rf_set_agc(struct tc90522_batch *b, enum mxl301rf_agc agc)
 {
-	u8	dat	= agc == MXL301RF_AGC_AUTO ? 0x40 : 0x00,
-		imsrst	= 0x01 << 6;
-	int	err	= mxl301rf_w(fe, 0x25, &dat, 1);
-
-	dat = 0x4c | (agc == MXL301RF_AGC_AUTO ? 0 : 1);
-	return	err				||
-		mxl301rf_w(fe, 0x23, &dat, 1)	||
-		mxl301rf_w(fe, 0x01, &imsrst, 1);
+	u8	dat[]	= {
+			agc == MXL301RF_AGC_AUTO ? 0x40 : 0x00,		/* 0x25	*/
+			0x4c | (agc == MXL301RF_AGC_AUTO ? 0 : 1),	/* 0x23	*/
+			0x01 << 6,					/* 0x01 imsrst	*/
+		};
+
+	tc90522_batch_w(b, 0x25, dat, 1);
+	tc90522_batch_w(b, 0x23, dat + 1, 1);
+	tc90522_batch_w(b, 0x01, dat + 2, 1);
 }
 
 int mxl301rf_sleep(struct dvb_frontend *fe)
 {
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
 	u8	buf	= (1 << 7) | (1 << 4),
 		dat[]	= {0x01, 0x00, 0x13, 0x00};
-	int	err	= mxl301rf_set_agc(fe, MXL301RF_AGC_MANUAL);
 
-	if (err)
-		return err;
-	mxl301rf_w_tuner(fe, dat, sizeof(dat));
-	return mxl301rf_w(fe, 0x03, &buf, 1);
+	mxl301rf_set_agc(&b, MXL301RF_AGC_MANUAL);
+	if (tc90522_batch_run(&b))
+		return b.err;
+	mxl301rf_b_tuner(fe, &b, dat, sizeof(dat));
+	mxl301rf_run(fe, &b);
+	b.err = 0;				/* tuner write errors were never fatal */
+	tc90522_batch_w(&b, 0x03, &buf, 1);
+	return tc90522_batch_run(&b);
 }
 
 int mxl301rf_tune(struct dvb_frontend *fe)
@@ -135,8 +146,8 @@ int mxl301rf_tune(struct dvb_frontend *fe)
 		0x6f, 0x8b,
 		0x70, 0x10+12,
 	};
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
 	u8	dat[20];
-	int	err	= mxl301rf_set_agc(fe, MXL301RF_AGC_MANUAL);
 	u32	freq	= fe->dtv_property_cache.frequency,
 		dig_rf	= freq / MHz,
 		tmp	= freq % MHz,
@@ -144,8 +155,6 @@ int mxl301rf_tune(struct dvb_frontend *fe)
 		fdiv	= 1000000;
 	unsigned long timeout;
 
-	if (err)
-		return err;
 	for (i = 0; i < 6; i++) {
 		dig_rf <<= 1;
 		fdiv /= 2;
@@ -168,46 +177,80 @@ int mxl301rf_tune(struct dvb_frontend *fe)
 	}
 	memcpy(dat, rf_dat, sizeof(rf_dat));
 
-	mxl301rf_w_tuner(fe, dat, 14);
-	msleep_interruptible(1);
-	mxl301rf_w_tuner(fe, dat + 14, 6);
-	msleep_interruptible(1);
+	mxl301rf_set_agc(&b, MXL301RF_AGC_MANUAL);
+	if (tc90522_batch_run(&b))
+		return b.err;
+	mxl301rf_b_tuner(fe, &b, dat, 14);
+	mxl301rf_run(fe, &b);
+	usleep_range(1000, 1200);
+	mxl301rf_b_tuner(fe, &b, dat + 14, 6);
+	mxl301rf_run(fe, &b);
+	usleep_range(1000, 1200);
 	dat[0] = 0x1a;
 	dat[1] = 0x0d;
-	mxl301rf_w_tuner(fe, dat, 2);
-	mxl301rf_w_tuner(fe, idac, sizeof(idac));
+	mxl301rf_b_tuner(fe, &b, dat, 2);
+	mxl301rf_b_tuner(fe, &b, idac, sizeof(idac));
+	mxl301rf_run(fe, &b);
+	b.err = 0;				/* tuner write errors were never fatal, the lock poll decides */
 	timeout = jiffies + msecs_to_jiffies(100);
-	while (time_before(jiffies, timeout)) {
-		if ((mxl301rf_r(fe, 0x16) & 0x0c) == 0x0c && (mxl301rf_r(fe, 0x16) & 0x03) == 0x03)
-			return mxl301rf_set_agc(fe, MXL301RF_AGC_AUTO);
-		msleep_interruptible(1);
+	while (time_before(jiffies, timeout)) {		/* the bus is free for other demods between polls */
+		if ((mxl301rf_r(fe, 0x16) & 0x0c) == 0x0c && (mxl301rf_r(fe, 0x16) & 0x03) == 0x03) {
+			mxl301rf_set_agc(&b, MXL301RF_AGC_AUTO);
+			return tc90522_batch_run(&b);
+		}
+		usleep_range(500, 1000);
 	}
 	return -ETIMEDOUT;
 }
 
 int mxl301rf_wakeup(struct dvb_frontend *fe)
 {
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
 	u8	buf	= (1 << 7) | (0 << 4),
 		dat[2]	= {0x01, 0x01};
-	int	err	= mxl301rf_w(fe, 0x03, &buf, 1);
 
-	if (err)
-		return err;
-	mxl301rf_w_tuner(fe, dat, sizeof(dat));
+	tc90522_batch_w(&b, 0x03, &buf, 1);
+	if (tc90522_batch_run(&b))
+		return b.err;
+	ptx_shadow_reset(&((struct mxl301rf *)i2c_get_clientdata(fe->tuner_priv))->hw);
+	mxl301rf_b_tuner(fe, &b, dat, sizeof(dat));
+	mxl301rf_run(fe, &b);
 	return 0;
 }
 
+int mxl301rf_cfg(struct dvb_frontend *fe)	/* demod side of the tuner link, lost with power */
+{
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
+	u8			d[]	= {0x10, 0x01};
+
+	tc90522_batch_w(&b, 0x1c, d, 1);
+	tc90522_batch_w(&b, 0x1d, d+1, 1);
+	return tc90522_batch_run(&b);
+}
+
+int mxl301rf_resume(struct dvb_frontend *fe)
+{
+	int	err	= mxl301rf_cfg(fe);
+
+	return err ? err : mxl301rf_wakeup(fe);
+}
+
 int mxl301rf_probe(struct i2c_client *t, const struct i2c_device_id *id)
 {
 	struct dvb_frontend	*fe	= t->dev.platform_data;
-	u8			d[]	= {0x10, 0x01};
+	struct mxl301rf		*m	= devm_kzalloc(&t->dev, sizeof(struct mxl301rf), GFP_KERNEL);
+	u8			volat[]	= {0x13, 0x16, 0x3b, 0x6f, 0x70};	/* tune start/abort, status, indexed IDAC */
 
+	if (!m)
+		return -ENOMEM;
+	ptx_shadow_init(&m->hw, volat, sizeof(volat));
+	i2c_set_clientdata(t, m);
 	fe->tuner_priv			= t;
 	fe->ops.tuner_ops.set_params	= mxl301rf_tune;
 	fe->ops.tuner_ops.sleep		= mxl301rf_sleep;
 	fe->ops.tuner_ops.init		= mxl301rf_wakeup;
-	return	mxl301rf_w(fe, 0x1c, d, 1)	||
-		mxl301rf_w(fe, 0x1d, d+1, 1);
+	fe->ops.tuner_ops.resume	= mxl301rf_resume;
+	return mxl301rf_cfg(fe);
 }
 
 static struct i2c_device_id mxl301rf_id[] = {
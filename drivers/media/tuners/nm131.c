@@ -5,43 +5,67 @@
 */
 
 #include <media/dvb_frontend.h>
+#include "ptx_shadow.h"
 #include "nm131.h"
 
+struct nm131 {
+	struct ptx_shadow	hw;	/* 1-byte RF registers 0x00-0xFF only */
+};
+
 bool nm131_w(struct i2c_client *c, u16 slvadr, u32 val, u32 sz)
 {
+	struct nm131	*n	= i2c_get_clientdata(c);
 	u8	buf[]	= {0xFE, 0xCE, slvadr >> 8, slvadr & 0xFF, 0, 0, 0, 0};
 	struct i2c_msg msg[] = {
 		{.addr = c->addr,	.flags = 0,	.buf = buf,	.len = sz + 4,},
 	};
 
 	*(u32 *)(buf + 4) = slvadr == 0x36 ? val & 0x7F : val;
-	return i2c_transfer(c->adapter, msg, 1) == 1;
+	if (sz == 1 && slvadr < 0x100 && !ptx_shadow_dirty(&n->hw, slvadr, buf[4]))
+		return true;
+	if (i2c_transfer(c->adapter, msg, 1) == 1)
+		return true;
+	ptx_shadow_reset(&n->hw);
+	return false;
 }
 
 bool nm131_w8(struct i2c_client *c, u8 slvadr, u8 dat)	// tc90522_i2c_w_tuner
 {
+	struct nm131	*n	= i2c_get_clientdata(c);
 	u8	buf[]	= {slvadr, dat};
 	struct i2c_msg	msg[]	= {
 		{.addr = c->addr,	.flags = 0,	.buf = buf,	.len = 2,},
 	};
-	return i2c_transfer(c->adapter, msg, 1) == 1;
+
+	ptx_shadow_forget(&n->hw, slvadr);	/* always written: may be a trigger, re-read before the next RMW */
+	if (i2c_transfer(c->adapter, msg, 1) == 1)
+		return true;
+	ptx_shadow_reset(&n->hw);
+	return false;
 }
 
 bool nm131_r(struct i2c_client *c, u16 slvadr, u8 *dat, u32 sz)
 {
+	struct nm131	*n	= i2c_get_clientdata(c);
+	bool	byte	= sz == 1 && slvadr < 0x100,
+		ret;
 	u8	rcmd[]	= {0xFE, 0xCF},
-		*buf	= kzalloc(sz, GFP_KERNEL);
-	bool	ret;
+		*buf;
 	struct i2c_msg msg[] = {
 		{.addr = 0x80 | c->addr,	.flags = 0,		.buf = rcmd,	.len = 2,},
-		{.addr = c->addr,		.flags = I2C_M_RD,	.buf = buf,	.len = sz,},
+		{.addr = c->addr,		.flags = I2C_M_RD,	.len = sz,},
 	};
 
+	if (byte && ptx_shadow_get(&n->hw, slvadr, dat))
+		return true;
+	buf = msg[1].buf = kzalloc(sz, GFP_KERNEL);
 	if (!buf)
 		return false;
 	ret	= nm131_w(c, slvadr, 0, 0) && i2c_transfer(c->adapter, msg, 2) == 2;
 	memcpy(dat, buf, sz);
 	kfree(buf);
+	if (ret && byte)
+		ptx_shadow_set(&n->hw, slvadr, *dat);
 	return ret;
 }
 
@@ -177,8 +201,9 @@ int nm131_tune(struct dvb_frontend *fe)
 		0 : -EIO;
 }
 
-int nm131_probe(struct i2c_client *c, const struct i2c_device_id *id)
+int nm131_por(struct dvb_frontend *fe)	/* power-on defaults, at probe & after the chip lost power */
 {
+	struct i2c_client	*c	= fe->tuner_priv;
 	struct tnr_rf_reg_t {
 		u8 slvadr;
 		u8 val;
@@ -201,11 +226,9 @@ int nm131_probe(struct i2c_client *c, const struct i2c_device_id *id)
 	const tnr_bb_defaults_lut[2] = {
 		{356, 2048},	{448, 764156359}
 	};
-	u8			i;
-	struct dvb_frontend	*fe	= c->dev.platform_data;
+	u8	i;
 
-	fe->tuner_priv			= c;
-	fe->ops.tuner_ops.set_params	= nm131_tune;
+	ptx_shadow_reset(&((struct nm131 *)i2c_get_clientdata(c))->hw);
 	if (nm131_w8(c, 0xB0, 0xA0)	&&
 		nm131_w8(c, 0xB2, 0x3D)	&&
 		nm131_w8(c, 0xB3, 0x25)	&&
@@ -233,6 +256,22 @@ int nm131_probe(struct i2c_client *c, const struct i2c_device_id *id)
 	return 0;
 }
 
+int nm131_probe(struct i2c_client *c, const struct i2c_device_id *id)
+{
+	u8			volat[]	= {0x1D, 0x21};	/* partly chip owned */
+	struct dvb_frontend	*fe	= c->dev.platform_data;
+	struct nm131		*n	= devm_kzalloc(&c->dev, sizeof(struct nm131), GFP_KERNEL);
+
+	if (!n)
+		return -ENOMEM;
+	ptx_shadow_init(&n->hw, volat, sizeof(volat));
+	i2c_set_clientdata(c, n);
+	fe->tuner_priv			= c;
+	fe->ops.tuner_ops.set_params	= nm131_tune;
+	fe->ops.tuner_ops.resume	= nm131_por;
+	return nm131_por(fe);
+}
+
 static struct i2c_device_id nm131_id[] = {
 	{NM131_MODNAME, 0},
 	{},
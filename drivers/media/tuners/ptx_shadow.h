@@ -0,0 +1,68 @@
+/*
+ * Write-through register shadow for the PTX ISDB tuners
+ *
+ * Copyright (C) Budi Rachmanto, AreMa Inc. <info@are.ma>
+ *
+ * A register becomes known once written or read. Writing the value it already
+ * holds is skipped & reading it is served from memory. Volatile registers
+ * (status, self-clearing triggers, indexed access) always go to the chip.
+ * Reset the shadow whenever the chip may have lost its state: power up, wakeup
+ * from sleep or a failed transfer.
+ */
+
+#ifndef	PTX_SHADOW_H
+#define	PTX_SHADOW_H
+
+#include <linux/bitmap.h>
+
+struct ptx_shadow {
+	DECLARE_BITMAP(known, 256);
+	DECLARE_BITMAP(volat, 256);
+	u8	val[256];
+};
+
+static inline void ptx_shadow_reset(struct ptx_shadow *s)
+{
+	bitmap_zero(s->known, 256);
+}
+
+static inline void ptx_shadow_init(struct ptx_shadow *s, const u8 *volat, u8 n)
+{
+	ptx_shadow_reset(s);
+	bitmap_zero(s->volat, 256);
+	while (n--)
+		set_bit(volat[n], s->volat);
+}
+
+static inline void ptx_shadow_set(struct ptx_shadow *s, u8 adr, u8 val)	/* value read from or written to the chip */
+{
+	if (test_bit(adr, s->volat))
+		return;
+	s->val[adr] = val;
+	set_bit(adr, s->known);
+}
+
+static inline void ptx_shadow_forget(struct ptx_shadow *s, u8 adr)	/* written behind the shadow's back */
+{
+	clear_bit(adr, s->known);
+}
+
+static inline bool ptx_shadow_get(struct ptx_shadow *s, u8 adr, u8 *val)
+{
+	if (!test_bit(adr, s->known))
+		return false;
+	*val = s->val[adr];
+	return true;
+}
+
+static inline bool ptx_shadow_dirty(struct ptx_shadow *s, u8 adr, u8 val)	/* true: write it, recorded as done */
+{
+	u8	cur;
+
+	if (ptx_shadow_get(s, adr, &cur) && cur == val)
+		return false;
+	ptx_shadow_set(s, adr, val);
+	return true;
+}
+
+#endif
@@ -15,10 +15,13 @@
 */
 
 #include <media/dvb_frontend.h>
+#include "tc90522.h"
+#include "ptx_shadow.h"
 #include "qm1d1c004x.h"
 
 struct qm1d1c004x {
-	u8 reg[32];
+	u8			reg[32];
+	struct ptx_shadow	hw;	/* what the chip holds */
 };
 
 bool qm1d1c004x_r(struct dvb_frontend *fe, u8 slvadr, u8 *dat)
@@ -37,33 +40,24 @@ bool qm1d1c004x_r(struct dvb_frontend *fe, u8 slvadr, u8 *dat)
 	return ret;
 }
 
-int qm1d1c004x_w(struct dvb_frontend *fe, u8 slvadr, u8 *dat, int len)
+void qm1d1c004x_b_tuner(struct dvb_frontend *fe, struct tc90522_batch *b, u8 adr, u8 dat)	/* shadowed tuner write */
 {
-	struct i2c_client	*d	= fe->demodulator_priv;
-	u8			*buf	= kzalloc(len + 1, GFP_KERNEL);
-	int			ret;
-	struct i2c_msg	msg[] = {
-		{.addr = d->addr,	.flags = 0,	.buf = buf,	.len = len + 1,},
-	};
+	struct i2c_client	*t	= fe->tuner_priv;
+	struct qm1d1c004x	*q	= i2c_get_clientdata(t);
+	u8			buf[]	= {adr, dat};
 
-	if (!buf)
-		return -ENOMEM;
-	buf[0]	= slvadr;
-	memcpy(buf + 1, dat, len);
-	ret	= i2c_transfer(d->adapter, msg, 1);
-	kfree(buf);
-	return	ret == 1 ? 0 : -EIO;
+	q->reg[adr] = dat;
+	if (ptx_shadow_dirty(&q->hw, adr, dat))
+		tc90522_batch_w_tuner(b, t, buf, 2);
 }
 
-int qm1d1c004x_w_tuner(struct dvb_frontend *fe, u8 adr, u8 dat)
+int qm1d1c004x_run(struct dvb_frontend *fe, struct tc90522_batch *b)
 {
-	struct i2c_client	*t	= fe->tuner_priv;
-	struct qm1d1c004x	*q	= i2c_get_clientdata(t);
-	u8			buf[]	= {t->addr << 1, adr, dat};
-	int			err	= qm1d1c004x_w(fe, 0xFE, buf, 3);
+	struct qm1d1c004x	*q	= i2c_get_clientdata(fe->tuner_priv);
 
-	q->reg[adr] = dat;
-	return err;
+	if (tc90522_batch_run(b))
+		ptx_shadow_reset(&q->hw);
+	return b->err;
 }
 
 enum qm1d1c004x_agc {
@@ -71,39 +65,37 @@ enum qm1d1c004x_agc {
 	QM1D1C004X_AGC_MANUAL,
 };
 
-int qm1d1c004x_set_agc(struct dvb_frontend *fe, enum qm1d1c004x_agc agc)
+void qm1d1c004x_set_agc(struct tc90522_batch *b, enum qm1d1c004x_agc agc)
 {
-	u8	dat		= (agc == QM1D1C004X_AGC_AUTO) ? 0xff : 0x00,
-		pskmsrst	= 0x01;
-	int	err		= qm1d1c004x_w(fe, 0x0a, &dat, 1);
-
-	if (err)
-		return err;
-	dat = 0xb0 | (agc == QM1D1C004X_AGC_AUTO ? 1 : 0);
-	err = qm1d1c004x_w(fe, 0x10, &dat, 1);
-	if (err)
-		return err;
-	dat = (agc == QM1D1C004X_AGC_AUTO) ? 0x40 : 0x00;
-	return	(err = qm1d1c004x_w(fe, 0x11, &dat, 1)) ?
-		err : qm1d1c004x_w(fe, 0x03, &pskmsrst, 1);
+	u8	dat[]	= {
+			agc == QM1D1C004X_AGC_AUTO ? 0xff : 0x00,		/* 0x0a	*/
+			0xb0 | (agc == QM1D1C004X_AGC_AUTO ? 1 : 0),		/* 0x10	*/
+			agc == QM1D1C004X_AGC_AUTO ? 0x40 : 0x00,		/* 0x11	*/
+			0x01,							/* 0x03 pskmsrst	*/
+		};
+
+	tc90522_batch_w(b, 0x0a, dat, 1);
+	tc90522_batch_w(b, 0x10, dat + 1, 1);
+	tc90522_batch_w(b, 0x11, dat + 2, 1);
+	tc90522_batch_w(b, 0x03, dat + 3, 1);
 }
 
 int qm1d1c004x_sleep(struct dvb_frontend *fe)
 {
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
 	u8	buf	= 1,
-		*reg	= ((struct qm1d1c004x *)fe->tuner_priv)->reg;
-
-	reg[0x01] &= (~(1 << 3)) & 0xff;
-	reg[0x01] |= 1 << 0;
-	reg[0x05] |= 1 << 3;
-	return	qm1d1c004x_set_agc(fe, QM1D1C004X_AGC_MANUAL)	||
-		qm1d1c004x_w_tuner(fe, 0x05, reg[0x05])		||
-		qm1d1c004x_w_tuner(fe, 0x01, reg[0x01])		||
-		qm1d1c004x_w(fe, 0x17, &buf, 1);
+		*reg	= ((struct qm1d1c004x *)i2c_get_clientdata(fe->tuner_priv))->reg;
+
+	qm1d1c004x_set_agc(&b, QM1D1C004X_AGC_MANUAL);
+	qm1d1c004x_b_tuner(fe, &b, 0x05, reg[0x05] | 1 << 3);
+	qm1d1c004x_b_tuner(fe, &b, 0x01, (reg[0x01] & ~(1 << 3) & 0xff) | 1 << 0);
+	tc90522_batch_w(&b, 0x17, &buf, 1);
+	return qm1d1c004x_run(fe, &b);
 }
 
 int qm1d1c004x_wakeup(struct dvb_frontend *fe)
 {
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
 	u8	regs[][32] = {
 			{	/* QM1D1C0042	Earthsoft PT3	*/
 			0x48, 0x1c, 0xa0, 0x10, 0xbc, 0xc5, 0x20, 0x33,	0x06, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00,
@@ -129,13 +121,12 @@ int qm1d1c004x_wakeup(struct dvb_frontend *fe)
 	if (i == ARRAY_SIZE(regs))
 		return -ENOTSUPP;
 	memcpy(reg, regs[i], 32);
-	reg[0x01] |= 1 << 3;
-	reg[0x01] &= (~(1 << 0)) & 0xff;
-	reg[0x05] &= (~(1 << 3)) & 0xff;
+	ptx_shadow_reset(&((struct qm1d1c004x *)i2c_get_clientdata(fe->tuner_priv))->hw);
 	dat = 0;
-	return	qm1d1c004x_w(fe, 0x17, &dat, 1)		||
-		qm1d1c004x_w_tuner(fe, 0x01, reg[0x01])	||
-		qm1d1c004x_w_tuner(fe, 0x05, reg[0x05]);
+	tc90522_batch_w(&b, 0x17, &dat, 1);
+	qm1d1c004x_b_tuner(fe, &b, 0x01, (reg[0x01] | 1 << 3) & ~(1 << 0) & 0xff);
+	qm1d1c004x_b_tuner(fe, &b, 0x05, reg[0x05] & ~(1 << 3) & 0xff);
+	return qm1d1c004x_run(fe, &b);
 }
 
 int qm1d1c004x_tune(struct dvb_frontend *fe)
@@ -145,61 +136,48 @@ int qm1d1c004x_tune(struct dvb_frontend *fe)
 		{1600000, 1, 4},	{1450000, 1, 3},	{1250000, 1, 2},
 		{1200000, 0, 7},	{ 975000, 0, 6},	{ 950000, 0, 0}
 	};
-	u8	*reg	= ((struct qm1d1c004x *)fe->tuner_priv)->reg;
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
+	u8	*reg	= ((struct qm1d1c004x *)i2c_get_clientdata(fe->tuner_priv))->reg;
 	u32	f_kHz	= fe->dtv_property_cache.frequency - 500,
 		XtalkHz	= 16000,
 		i	= ((f_kHz + XtalkHz / 2) / XtalkHz) * XtalkHz;
-	s64	b	= f_kHz - i;
+	s64	b_kHz	= f_kHz - i;
 	u8	N	= i / (4 * XtalkHz) - 3,
 		A	= (i / XtalkHz) - 4 * (N + 1) - 5;
-	int	sd	= b < 0 ? (0x100000 / XtalkHz) * b + 0x400000 : (0x100000 / XtalkHz) * b,
-		err	= qm1d1c004x_set_agc(fe, QM1D1C004X_AGC_MANUAL);
+	int	sd	= b_kHz < 0 ? (0x100000 / XtalkHz) * b_kHz + 0x400000 : (0x100000 / XtalkHz) * b_kHz;
+	unsigned long timeout;
 
-	if (err)
-		return -EIO;
+	qm1d1c004x_set_agc(&b, QM1D1C004X_AGC_MANUAL);
 
 	/* div2/vco_band */
 	for (i = 0; i < 8; i++)
 		if ((fgap_tab[i+1][0] <= f_kHz) && (f_kHz < fgap_tab[i][0]))
-			qm1d1c004x_w_tuner(fe, 0x02, (reg[0x02] & 0x0f) | fgap_tab[i][1] << 7 | fgap_tab[i][2] << 4);
-
-	reg[0x06] &= 0x40;
-	reg[0x06] |= N;
-	reg[0x07] &= 0xf0;
-	reg[0x07] |= A & 0x0f;
-
-	/* LPF */
-	reg[0x08] &= 0xf0;
-	reg[0x08] |= 0x09;
-	reg[0x13] &= 0x9f;
-	reg[0x13] |= 0x20;
-	err =	qm1d1c004x_w_tuner(fe, 0x06, reg[0x06])	||
-		qm1d1c004x_w_tuner(fe, 0x07, reg[0x07])	||
-		qm1d1c004x_w_tuner(fe, 0x08, (reg[0x08] & 0xf0) | 2);
-	if (err)
-		return err;
-	reg[0x09] &= 0xc0;
-	reg[0x09] |= (sd >> 16) & 0x3f;
-	reg[0x0a] = (sd >> 8) & 0xff;
-	reg[0x0b] = (sd >> 0) & 0xff;
-	err =	qm1d1c004x_w_tuner(fe, 0x09, reg[0x09])	||
-		qm1d1c004x_w_tuner(fe, 0x0a, reg[0x0a])	||
-		qm1d1c004x_w_tuner(fe, 0x0b, reg[0x0b])	||
-		qm1d1c004x_w_tuner(fe, 0x0c, reg[0x0c] & 0x3f);
-	if (err)
-		return err;
-	msleep_interruptible(1);
-	err =	qm1d1c004x_w_tuner(fe, 0x0c, reg[0x0c] | 0xc0)	||
-		qm1d1c004x_w_tuner(fe, 0x08, 0x09)		||
-		qm1d1c004x_w_tuner(fe, 0x13, reg[0x13]);
-	if (err)
-		return err;
-	for (i = 0; i < 500; i++) {
+			qm1d1c004x_b_tuner(fe, &b, 0x02, (reg[0x02] & 0x0f) | fgap_tab[i][1] << 7 | fgap_tab[i][2] << 4);
+
+	qm1d1c004x_b_tuner(fe, &b, 0x06, (reg[0x06] & 0x40) | N);
+	qm1d1c004x_b_tuner(fe, &b, 0x07, (reg[0x07] & 0xf0) | (A & 0x0f));
+	qm1d1c004x_b_tuner(fe, &b, 0x08, (reg[0x08] & 0xf0) | 2);	/* LPF */
+	qm1d1c004x_b_tuner(fe, &b, 0x09, (reg[0x09] & 0xc0) | ((sd >> 16) & 0x3f));
+	qm1d1c004x_b_tuner(fe, &b, 0x0a, (sd >> 8) & 0xff);
+	qm1d1c004x_b_tuner(fe, &b, 0x0b, (sd >> 0) & 0xff);
+	qm1d1c004x_b_tuner(fe, &b, 0x0c, reg[0x0c] & 0x3f);
+	if (qm1d1c004x_run(fe, &b))
+		return -EIO;
+	usleep_range(1000, 1200);
+	qm1d1c004x_b_tuner(fe, &b, 0x0c, reg[0x0c] | 0xc0);
+	qm1d1c004x_b_tuner(fe, &b, 0x08, 0x09);
+	qm1d1c004x_b_tuner(fe, &b, 0x13, (reg[0x13] & 0x9f) | 0x20);
+	if (qm1d1c004x_run(fe, &b))
+		return -EIO;
+	timeout = jiffies + msecs_to_jiffies(500);
+	while (time_before(jiffies, timeout)) {		/* the bus is free for other demods between polls */
 		if (!qm1d1c004x_r(fe, 0x0d, &reg[0x0d]))
 			return -EIO;
-		if (reg[0x0d] & 0x40)	/* locked */
-			return qm1d1c004x_set_agc(fe, QM1D1C004X_AGC_AUTO);
-		msleep_interruptible(1);
+		if (reg[0x0d] & 0x40) {	/* locked */
+			qm1d1c004x_set_agc(&b, QM1D1C004X_AGC_AUTO);
+			return tc90522_batch_run(&b);
+		}
+		usleep_range(500, 1000);
 	}
 	return -ETIMEDOUT;
 }
@@ -210,22 +188,40 @@ int qm1d1c004x_remove(struct i2c_client *t)
 	return 0;
 }
 
+int qm1d1c004x_cfg(struct dvb_frontend *fe)	/* demod side of the tuner link, lost with power */
+{
+	struct tc90522_batch	b	= {.demod = fe->demodulator_priv};
+	u8			d[]	= {0x10, 0x15, 0x04};
+
+	tc90522_batch_w(&b, 0x1e, d,   1);
+	tc90522_batch_w(&b, 0x1c, d+1, 1);
+	tc90522_batch_w(&b, 0x1f, d+2, 1);
+	return tc90522_batch_run(&b);
+}
+
+int qm1d1c004x_resume(struct dvb_frontend *fe)
+{
+	int	err	= qm1d1c004x_cfg(fe);
+
+	return err ? err : qm1d1c004x_wakeup(fe);
+}
+
 int qm1d1c004x_probe(struct i2c_client *t, const struct i2c_device_id *id)
 {
 	struct dvb_frontend	*fe	= t->dev.platform_data;
 	struct qm1d1c004x	*q	= kzalloc(sizeof(struct qm1d1c004x), GFP_KERNEL);
-	u8			d[]	= {0x10, 0x15, 0x04};
+	u8			volat[]	= {0x08, 0x0c, 0x0d, 0x13};	/* LPF tuning triggers, lock status */
 
 	if (!q)
 		return -ENOMEM;
+	ptx_shadow_init(&q->hw, volat, sizeof(volat));
 	i2c_set_clientdata(t, q);
 	fe->tuner_priv			= t;
 	fe->ops.tuner_ops.set_params	= qm1d1c004x_tune;
 	fe->ops.tuner_ops.sleep		= qm1d1c004x_sleep;
 	fe->ops.tuner_ops.init		= qm1d1c004x_wakeup;
-	return	qm1d1c004x_w(fe, 0x1e, d,   1)	||
-		qm1d1c004x_w(fe, 0x1c, d+1, 1)	||
-		qm1d1c004x_w(fe, 0x1f, d+2, 1);
+	fe->ops.tuner_ops.resume	= qm1d1c004x_resume;
+	return qm1d1c004x_cfg(fe);
 }
 
 static struct i2c_device_id qm1d1c004x_id[] = {
@@ -5,10 +5,16 @@
 */
 
 #include <media/dvb_frontend.h>
+#include "ptx_shadow.h"
 #include "tda2014x.h"
 
+struct tda2014x {
+	struct ptx_shadow	hw;
+};
+
 int tda2014x_r(struct i2c_client *c, u8 slvadr)
 {
+	struct tda2014x	*t	= i2c_get_clientdata(c);
 	u8	buf[]	= {0xFE, 0xA8, slvadr},
 		rcmd[]	= {0xFE, 0xA9},
 		ret	= 0;
@@ -17,13 +23,19 @@ int tda2014x_r(struct i2c_client *c, u8 slvadr)
 		{.addr = 0x80 | c->addr,	.flags = 0,		.buf = rcmd,	.len = 2,},
 		{.addr = c->addr,		.flags = I2C_M_RD,	.buf = &ret,	.len = 1,},
 	};
-	return i2c_transfer(c->adapter, msg, 3) == 3 ? ret : -EREMOTEIO;
+
+	if (ptx_shadow_get(&t->hw, slvadr, &ret))
+		return ret;
+	if (i2c_transfer(c->adapter, msg, 3) != 3)
+		return -EREMOTEIO;
+	ptx_shadow_set(&t->hw, slvadr, ret);
+	return ret;
 }
 
 bool tda2014x_r8(struct i2c_client *c, u16 slvadr, u8 start_bit, u8 nbits, u8 *rdat)
 {
-	u8	mask	= nbits > 7 ? 0xFF : ((1 << nbits) - 1) << start_bit,
-		val	= tda2014x_r(c, slvadr);
+	u8	mask	= nbits > 7 ? 0xFF : ((1 << nbits) - 1) << start_bit;
+	int	val	= tda2014x_r(c, slvadr);
 
 	if (val < 0)
 		return false;
@@ -33,23 +45,30 @@ bool tda2014x_r8(struct i2c_client *c, u16 slvadr, u8 start_bit, u8 nbits, u8 *r
 
 bool tda2014x_w8(struct i2c_client *c, u8 slvadr, u8 dat)	// tc90522_i2c_w_tuner
 {
+	struct tda2014x	*t	= i2c_get_clientdata(c);
 	u8		buf[]	= {slvadr, dat};
 	struct i2c_msg	msg[]	= {
 		{.addr = c->addr,	.flags = 0,	.buf = buf,	.len = 2,},
 	};
-	return i2c_transfer(c->adapter, msg, 1) == 1;
+
+	ptx_shadow_forget(&t->hw, slvadr);	/* always written: may be a trigger, re-read before the next RMW */
+	if (i2c_transfer(c->adapter, msg, 1) == 1)
+		return true;
+	ptx_shadow_reset(&t->hw);
+	return false;
 }
 
 bool tda2014x_w16(struct i2c_client *c, u16 slvadr, u8 start_bit, u8 nbits, u8 nbytes, bool rmw, u8 access, u16 wdat)
 {
+	struct tda2014x	*t	= i2c_get_clientdata(c);
 	u16	mask	= nbits > 15 ? 0xFFFF : ((1 << nbits) - 1) << start_bit,
 		val	= mask & (wdat << start_bit);
 	u8	*wval	= (u8 *)&val,
 		i;
 
 	for (i = 0, nbytes = !nbytes ? 1 : nbytes > 2 ? 2 : nbytes; access & 2 && nbytes; i++, nbytes--) {
-		u8	buf[]	= {0xFE, 0xA8, slvadr + i, 0},
-			ret	= tda2014x_r(c, slvadr + i);
+		u8	buf[]	= {0xFE, 0xA8, slvadr + i, 0};
+		int	ret	= tda2014x_r(c, slvadr + i);
 		struct i2c_msg msg[] = {
 			{.addr = c->addr,	.flags = 0,	.buf = buf,	.len = 4,},
 		};
@@ -60,8 +79,12 @@ bool tda2014x_w16(struct i2c_client *c, u16 slvadr, u8 start_bit, u8 nbits, u8 n
 			wval[nbytes - 1] |= ~(mask >> 8 * i) & ret;
 		buf[3] = wval[nbytes - 1];
 
-		if (i2c_transfer(c->adapter, msg, 1) != 1)
+		if (!ptx_shadow_dirty(&t->hw, buf[2], buf[3]))
+			continue;
+		if (i2c_transfer(c->adapter, msg, 1) != 1) {
+			ptx_shadow_reset(&t->hw);
 			return false;
+		}
 	}
 	return true;
 }
@@ -252,14 +275,12 @@ LABEL_36:
 		tda2014x_w8(c, 3, 1)) * -EIO;
 }
 
-int tda2014x_probe(struct i2c_client *c, const struct i2c_device_id *id)
+int tda2014x_por(struct dvb_frontend *fe)	/* power-on programming, at probe & after the chip lost power */
 {
+	struct i2c_client	*c	= fe->tuner_priv;
 	u8			val	= 0;
-	struct dvb_frontend	*fe	= c->dev.platform_data;
 
-	fe->tuner_priv			= c;
-	fe->ops.tuner_ops.set_params	= tda2014x_tune;
-	fe->dtv_property_cache.frequency = 1318000;
+	ptx_shadow_reset(&((struct tda2014x *)i2c_get_clientdata(c))->hw);
 	return	!(tda2014x_w8(c, 0x13, 0)	&&
 		tda2014x_w8(c, 0x15, 0)	&&
 		tda2014x_w8(c, 0x17, 0)	&&
@@ -347,6 +368,23 @@ int tda2014x_probe(struct i2c_client *c, const struct i2c_device_id *id)
 		tda2014x_tune(fe);
 }
 
+int tda2014x_probe(struct i2c_client *c, const struct i2c_device_id *id)
+{
+	u8			volat[]	= {0x10, 0x11, 0x13, 0x15};	/* VCO calibration & PLL lock status/triggers */
+	struct dvb_frontend	*fe	= c->dev.platform_data;
+	struct tda2014x		*t	= devm_kzalloc(&c->dev, sizeof(struct tda2014x), GFP_KERNEL);
+
+	if (!t)
+		return -ENOMEM;
+	ptx_shadow_init(&t->hw, volat, sizeof(volat));
+	i2c_set_clientdata(c, t);
+	fe->tuner_priv			= c;
+	fe->ops.tuner_ops.set_params	= tda2014x_tune;
+	fe->ops.tuner_ops.resume	= tda2014x_por;
+	fe->dtv_property_cache.frequency = 1318000;
+	return tda2014x_por(fe);
+}
+
 static struct i2c_device_id tda2014x_id[] = {
 	{TDA2014X_MODNAME, 0},
 	{},
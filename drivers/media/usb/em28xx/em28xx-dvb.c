@@ -30,6 +30,8 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/usb.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
 
 #include "ptx_common.h"
 #include "em28xx.h"
@@ -74,6 +76,14 @@ static unsigned int debug;
 module_param(debug, int, 0644);
 MODULE_PARM_DESC(debug, "enable debug messages [dvb]");
 
+static unsigned int dvb_urbs = EM28XX_DVB_NUM_BUFS;
+module_param(dvb_urbs, uint, 0444);
+MODULE_PARM_DESC(dvb_urbs, "URBs in flight while streaming (2-32, default 5)");
+
+static unsigned int dvb_bulk_size = 512 * EM28XX_DVB_BULK_PACKET_MULTIPLIER;
+module_param(dvb_bulk_size, uint, 0444);
+MODULE_PARM_DESC(dvb_bulk_size, "bytes per bulk URB, in 512 byte packets (8192-1048576, default 196608)");
+
 DVB_DEFINE_MOD_OPT_ADAPTER_NR(adapter_nr);
 
 #define dprintk(level, fmt, arg...) do {			\
@@ -103,6 +113,19 @@ struct em28xx_dvb {
 	int			lna_gpio;
 	struct i2c_client	*i2c_client_demod;
 	struct i2c_client	*i2c_client_tuner;
+
+	/* URB pool, from the module parameters at bind time */
+	int			num_bufs;
+	int			bulk_multiplier;
+
+	/* streaming statistics, updated on URB completion */
+	struct dentry		*dbgfs;
+	u64			urbs;
+	u64			urb_errors;
+	u64			short_urbs;	/* bulk URBs ending before their buffer was full */
+	u64			filter_calls;
+	u64			callback_ns;	/* time in the URB data callback, total */
+	u64			callback_max_ns;
 };
 
 static inline void print_err_status(struct em28xx *dev,
@@ -144,9 +167,19 @@ static inline void print_err_status(struct em28xx *dev,
 	}
 }
 
+static inline void em28xx_dvb_filter(struct em28xx_dvb *dvb, const u8 *buf,
+				     size_t len)
+{
+	dvb->filter_calls++;
+	dvb_dmx_swfilter(&dvb->demux, buf, len);
+}
+
 static inline int em28xx_dvb_urb_data_copy(struct em28xx *dev, struct urb *urb)
 {
+	struct em28xx_dvb *dvb;
 	int xfer_bulk, num_packets, i;
+	unsigned int start = 0, len = 0;
+	u64 t0 = ktime_get_ns();
 
 	if (!dev)
 		return 0;
@@ -154,8 +187,12 @@ static inline int em28xx_dvb_urb_data_copy(struct em28xx *dev, struct urb *urb)
 	if (dev->disconnected)
 		return 0;
 
-	if (urb->status < 0)
+	dvb = dev->dvb;
+	dvb->urbs++;
+	if (urb->status < 0) {
+		dvb->urb_errors++;
 		print_err_status(dev, -1, urb->status);
+	}
 
 	xfer_bulk = usb_pipebulk(urb->pipe);
 
@@ -173,23 +210,44 @@ static inline int em28xx_dvb_urb_data_copy(struct em28xx *dev, struct urb *urb)
 			}
 			if (!urb->actual_length)
 				continue;
-			dvb_dmx_swfilter(&dev->dvb->demux, urb->transfer_buffer,
-					 urb->actual_length);
+			if (urb->actual_length < urb->transfer_buffer_length)
+				dvb->short_urbs++;
+			em28xx_dvb_filter(dvb, urb->transfer_buffer,
+					  urb->actual_length);
 		} else {
-			if (urb->iso_frame_desc[i].status < 0) {
-				print_err_status(dev, i,
-						 urb->iso_frame_desc[i].status);
-				if (urb->iso_frame_desc[i].status != -EPROTO)
+			struct usb_iso_packet_descriptor *frame =
+						&urb->iso_frame_desc[i];
+
+			if (frame->status < 0) {
+				dvb->urb_errors++;
+				print_err_status(dev, i, frame->status);
+				if (frame->status != -EPROTO)
 					continue;
 			}
-			if (!urb->iso_frame_desc[i].actual_length)
+			if (!frame->actual_length)
 				continue;
-			dvb_dmx_swfilter(&dev->dvb->demux,
-					 urb->transfer_buffer +
-					 urb->iso_frame_desc[i].offset,
-					 urb->iso_frame_desc[i].actual_length);
+			/*
+			 * Frames back to back in the buffer go to the demux
+			 * in one call, a short or dropped frame ends the run.
+			 */
+			if (len && frame->offset != start + len) {
+				em28xx_dvb_filter(dvb,
+						  urb->transfer_buffer + start,
+						  len);
+				len = 0;
+			}
+			if (!len)
+				start = frame->offset;
+			len += frame->actual_length;
 		}
 	}
+	if (len)
+		em28xx_dvb_filter(dvb, urb->transfer_buffer + start, len);
+
+	t0 = ktime_get_ns() - t0;
+	dvb->callback_ns += t0;
+	if (dvb->callback_max_ns < t0)
+		dvb->callback_max_ns = t0;
 
 	return 0;
 }
@@ -205,7 +263,7 @@ static int em28xx_start_streaming(struct em28xx_dvb *dvb)
 		if (!dev->dvb_ep_bulk)
 			return -ENODEV;
 		dvb_max_packet_size = 512; /* USB 2.0 spec */
-		packet_multiplier = EM28XX_DVB_BULK_PACKET_MULTIPLIER;
+		packet_multiplier = dvb->bulk_multiplier;
 		dvb_alt = 0;
 	} else { /* isoc */
 		if (!dev->dvb_ep_isoc)
@@ -223,13 +281,13 @@ static int em28xx_start_streaming(struct em28xx_dvb *dvb)
 		return rc;
 
 	dprintk(1, "Using %d buffers each with %d x %d bytes, alternate %d\n",
-		EM28XX_DVB_NUM_BUFS,
+		dvb->num_bufs,
 		packet_multiplier,
 		dvb_max_packet_size, dvb_alt);
 
 	return em28xx_init_usb_xfer(dev, EM28XX_DIGITAL_MODE,
 				    dev->dvb_xfer_bulk,
-				    EM28XX_DVB_NUM_BUFS,
+				    dvb->num_bufs,
 				    dvb_max_packet_size,
 				    packet_multiplier,
 				    em28xx_dvb_urb_data_copy);
@@ -1108,6 +1166,24 @@ static void em28xx_unregister_dvb(struct em28xx_dvb *dvb)
 	dvb_unregister_adapter(&dvb->adapter);
 }
 
+static void em28xx_dvb_debugfs_init(struct em28xx *dev)
+{
+	struct em28xx_dvb *dvb = dev->dvb;
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s-%s", KBUILD_MODNAME,
+		 dev_name(&dev->udev->dev));
+	dvb->dbgfs = debugfs_create_dir(name, NULL);
+	debugfs_create_u64("urbs", 0444, dvb->dbgfs, &dvb->urbs);
+	debugfs_create_u64("urb_errors", 0444, dvb->dbgfs, &dvb->urb_errors);
+	debugfs_create_u64("short_urbs", 0444, dvb->dbgfs, &dvb->short_urbs);
+	debugfs_create_u64("filter_calls", 0444, dvb->dbgfs,
+			   &dvb->filter_calls);
+	debugfs_create_u64("callback_ns", 0444, dvb->dbgfs, &dvb->callback_ns);
+	debugfs_create_u64("callback_max_ns", 0444, dvb->dbgfs,
+			   &dvb->callback_max_ns);
+}
+
 static int em28xx_dvb_init(struct em28xx *dev)
 {
 	int result = 0;
@@ -1132,18 +1208,21 @@ static int em28xx_dvb_init(struct em28xx *dev)
 	}
 	dev->dvb = dvb;
 	dvb->fe[0] = dvb->fe[1] = NULL;
+	dvb->num_bufs = clamp_t(unsigned int, dvb_urbs, 2, EM28XX_DVB_MAX_BUFS);
+	dvb->bulk_multiplier = clamp_t(unsigned int, dvb_bulk_size,
+				       8192, 1048576) / 512;
 
 	/* pre-allocate DVB usb transfer buffers */
 	if (dev->dvb_xfer_bulk) {
 		result = em28xx_alloc_urbs(dev, EM28XX_DIGITAL_MODE,
 					   dev->dvb_xfer_bulk,
-					   EM28XX_DVB_NUM_BUFS,
+					   dvb->num_bufs,
 					   512,
-					   EM28XX_DVB_BULK_PACKET_MULTIPLIER);
+					   dvb->bulk_multiplier);
 	} else {
 		result = em28xx_alloc_urbs(dev, EM28XX_DIGITAL_MODE,
 					   dev->dvb_xfer_bulk,
-					   EM28XX_DVB_NUM_BUFS,
+					   dvb->num_bufs,
 					   dev->dvb_max_pkt_size_isoc,
 					   EM28XX_DVB_NUM_ISOC_PACKETS);
 	}
@@ -1763,6 +1842,8 @@ static int em28xx_dvb_init(struct em28xx *dev)
 	if (result < 0)
 		goto out_free;
 
+	em28xx_dvb_debugfs_init(dev);
+
 	em28xx_info("DVB extension successfully initialized\n");
 
 	kref_get(&dev->ref);
@@ -1809,6 +1890,7 @@ static int em28xx_dvb_fini(struct em28xx *dev)
 	client = dvb->i2c_client_tuner;
 
 	em28xx_uninit_usb_xfer(dev, EM28XX_DIGITAL_MODE);
+	debugfs_remove_recursive(dvb->dbgfs);
 
 	if (dev->disconnected) {
 		/* We cannot tell the device to sleep
@@ -172,6 +172,7 @@
 /* number of buffers for isoc transfers */
 #define EM28XX_NUM_BUFS 5
 #define EM28XX_DVB_NUM_BUFS 5
+#define EM28XX_DVB_MAX_BUFS 32
 
 /* max number of I2C buses on em28xx devices */
 #define NUM_I2C_BUSES	2
@@ -14,6 +14,9 @@
 #include <linux/interrupt.h>
 #include <media/dvb_frontend.h>
 #include "ptx_common.h"
+#define PTX_TRACE_SYSTEM pxq3pe_drv
+#define CREATE_TRACE_POINTS
+#include "ptx_trace.h"	/* instantiates the events used by ptx_common.o */
 #include "tc90522.h"
 
 MODULE_AUTHOR(PTX_AUTH);